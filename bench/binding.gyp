@@ -0,0 +1,74 @@
+{
+  "targets": [
+    {
+      "target_name": "detection",
+      "sources": [
+        "detection_synthetic.cpp",
+        "../src/detection.cpp",
+        "../src/detectionStats.cpp",
+        "../src/deviceInterest.cpp",
+        "../src/deviceList.cpp",
+        "../src/eventDebouncer.cpp",
+        "../src/eventQueue.cpp",
+        "../src/internedString.cpp",
+        "../src/subscriptionTable.cpp"
+      ],
+      "include_dirs" : [
+        "../src"
+      ],
+      "defines": [
+        "NAPI_VERSION=4"
+      ]
+    },
+    {
+      "target_name": "detection_replay",
+      "sources": [
+        "detection_replay.cpp",
+        "../src/detection.cpp",
+        "../src/detectionStats.cpp",
+        "../src/detection_linux.cpp",
+        "../src/deviceInterest.cpp",
+        "../src/deviceList.cpp",
+        "../src/eventDebouncer.cpp",
+        "../src/eventQueue.cpp",
+        "../src/internedString.cpp",
+        "../src/replayEventSource.cpp",
+        "../src/subscriptionTable.cpp"
+      ],
+      "include_dirs" : [
+        "../src"
+      ],
+      "defines": [
+        "NAPI_VERSION=4"
+      ],
+      "libraries": [
+        "-lpthread"
+      ]
+    },
+    {
+      "target_name": "find_allocations",
+      "type": "executable",
+      "sources": [
+        "find_allocations.cpp",
+        "../src/deviceList.cpp",
+        "../src/eventQueue.cpp",
+        "../src/internedString.cpp"
+      ],
+      "include_dirs": [
+        "../src"
+      ]
+    },
+    {
+      "target_name": "find_filter",
+      "type": "executable",
+      "sources": [
+        "find_filter.cpp",
+        "../src/deviceList.cpp",
+        "../src/internedString.cpp"
+      ],
+      "include_dirs": [
+        "../src"
+      ]
+    }
+  ]
+}
@@ -0,0 +1,54 @@
+// Event source for the replay build of the addon: plays back the file
+// named by USB_DETECTION_REPLAY through the real monitor thread, queue
+// and JS delivery path, without udev.
+//
+// Each device is stamped with the time it left the source, in
+// microseconds of the uv_hrtime() clock truncated to 31 bits, in its
+// `locationId`, so replay_events.js can measure latency into JS.
+
+#include "eventSource.h"
+#include "replayEventSource.h"
+
+#include <uv.h>
+
+class LatencyStampedSource : public DeviceEventSource {
+	public:
+		explicit LatencyStampedSource(DeviceEventSource* source) : source(source) {}
+		~LatencyStampedSource() {
+			delete source;
+		}
+
+		bool Open() {
+			return source->Open();
+		}
+
+		void Enumerate(std::vector<DeviceSourceEvent_t>* devices) {
+			source->Enumerate(devices);
+		}
+
+		bool Receive(DeviceSourceEvent_t* event) {
+			if (!source->Receive(event)) {
+				return false;
+			}
+
+			event->device.locationId = (int) ((uv_hrtime() / 1000) & 0x7fffffff);
+			return true;
+		}
+
+		void Interrupt() {
+			source->Interrupt();
+		}
+
+	private:
+		DeviceEventSource* source;
+};
+
+DeviceEventSource* CreateDeviceEventSource() {
+	DeviceEventSource* replay = ReplayEventSource::FromEnvironment();
+	if (!replay) {
+		// Open() reports the missing file
+		replay = new ReplayEventSource("", 0);
+	}
+
+	return new LatencyStampedSource(replay);
+}
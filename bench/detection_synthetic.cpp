@@ -0,0 +1,59 @@
+// Stand-in platform backend for benchmarking: instead of talking to the
+// OS it fills the device list with synthetic devices.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "detection.h"
+#include "deviceList.h"
+
+#define SYNTHETIC_DEVICES_ENV "USB_DETECTION_SYNTHETIC_DEVICES"
+#define SYNTHETIC_DEVICES_DEFAULT 5000
+#define SYNTHETIC_VENDORS 50
+
+void InitDetection() {
+	const char* env = getenv(SYNTHETIC_DEVICES_ENV);
+	int count = env ? atoi(env) : SYNTHETIC_DEVICES_DEFAULT;
+	// Room for the prefix and any int
+	char key[48];
+
+	for (int i = 0; i < count; i++) {
+		DeviceItem_t* item = new DeviceItem_t();
+		item->deviceParams.locationId = i;
+		item->deviceParams.vendorId = (i % SYNTHETIC_VENDORS) + 1;
+		item->deviceParams.productId = i;
+		item->deviceParams.deviceName = "Synthetic USB Device";
+		item->deviceParams.manufacturer = "Synthetic Devices Inc.";
+		item->deviceParams.serialNumber = "0123456789";
+		item->deviceParams.deviceAddress = i % 128;
+		item->deviceState = DeviceState_Connect;
+
+		snprintf(key, sizeof(key), "/dev/bus/usb/synthetic/%d", i);
+		AddItemToList(key, item);
+	}
+
+	NotifyReady();
+}
+
+bool TeardownDetection() {
+	// Keep the devices for the next round
+	return false;
+}
+
+void Start() {
+}
+
+void Stop() {
+}
+
+void EIO_Find(napi_env env, void* baton) {
+	ListBaton* data = static_cast<ListBaton*>(baton);
+
+	data->snapshot = GetDeviceSnapshot();
+	CreateFilteredRecordList(data->snapshot.get(), &data->results, data->vid, data->pid);
+}
+
+bool ReadDeviceDetails(const char* portPath, DeviceDetails_t* details) {
+	// Synthetic devices have no sysfs entry
+	return false;
+}
@@ -0,0 +1,47 @@
+// Measures how many device objects per second find() and findSync() can
+// hand to JS, against a build of the addon that uses the synthetic
+// backend (5000 devices unless USB_DETECTION_SYNTHETIC_DEVICES is set).
+
+var detection = require('./build/Release/detection.node');
+
+var ROUNDS = 200;
+
+function report(name, objects, elapsed) {
+	var seconds = elapsed[0] + elapsed[1] / 1e9;
+	console.log(name + ': ' + Math.round(objects / seconds) + ' objects/s');
+}
+
+function benchFindSync() {
+	var objects = 0;
+	var start = process.hrtime();
+	for(var i = 0; i < ROUNDS; i++) {
+		objects += detection.findSync().length;
+	}
+	report('findSync()', objects, process.hrtime(start));
+}
+
+function benchFind(done) {
+	var objects = 0;
+	var remaining = ROUNDS;
+	var start = process.hrtime();
+
+	var next = function() {
+		detection.find(function(err, devices) {
+			objects += devices.length;
+			if(--remaining > 0) {
+				next();
+				return;
+			}
+
+			report('find()', objects, process.hrtime(start));
+			done();
+		});
+	};
+	next();
+}
+
+// Warm up so the first measured round is not paying for lazy compilation
+detection.findSync();
+
+benchFindSync();
+benchFind(function() {});
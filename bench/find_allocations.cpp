@@ -0,0 +1,212 @@
+// Counts allocations and bytes allocated per find and per hotplug event
+// (add and remove, from the device list through the event queue), with a
+// counting global operator new plus the slab pools' own totals.
+//
+// "copied" is how records used to be handed around: every event got its
+// own copy of the device and find copied every match. "shared" is what
+// the backends do now, passing the list's immutable records by reference.
+
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "deviceList.h"
+#include "eventQueue.h"
+
+#define ROUNDS 1000
+
+size_t allocations = 0;
+size_t bytes = 0;
+
+void* operator new(size_t size) {
+	allocations++;
+	bytes += size;
+
+	void* ptr = malloc(size ? size : 1);
+	if (ptr == NULL) {
+		abort();
+	}
+
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t size) noexcept {
+	free(ptr);
+}
+
+typedef struct {
+	double allocations;
+	double bytes;
+} Cost_t;
+
+class CostMeter {
+	public:
+		CostMeter() : startAllocations(Allocations()), startBytes(Bytes()) {}
+
+		Cost_t PerRound() const {
+			Cost_t cost;
+			cost.allocations = (double) (Allocations() - startAllocations) / ROUNDS;
+			cost.bytes = (double) (Bytes() - startBytes) / ROUNDS;
+
+			return cost;
+		}
+
+	private:
+		static size_t Allocations() {
+			return allocations + GetSlabPoolStats().allocations;
+		}
+
+		static size_t Bytes() {
+			return bytes + GetSlabPoolStats().bytes;
+		}
+
+		size_t startAllocations;
+		size_t startBytes;
+};
+
+DeviceEventQueue queue;
+
+void Populate(int count) {
+	char key[32];
+	for (int i = 0; i < count; i++) {
+		DeviceItem_t* item = new DeviceItem_t();
+		item->deviceParams.vendorId = (i % 50) + 1;
+		item->deviceParams.productId = i;
+		item->deviceParams.deviceName = "Synthetic USB Device";
+		item->deviceParams.manufacturer = "Synthetic Devices Inc.";
+
+		snprintf(key, sizeof(key), "/dev/bus/usb/%03d/%03d", i / 128, i % 128);
+		AddItemToList(key, item);
+	}
+}
+
+void Clear(int count) {
+	char key[32];
+	for (int i = 0; i < count; i++) {
+		snprintf(key, sizeof(key), "/dev/bus/usb/%03d/%03d", i / 128, i % 128);
+		DeviceItem_t* item = GetItemFromList(key);
+		RemoveItemFromList(item);
+		delete item;
+	}
+}
+
+Cost_t CopiedFind() {
+	CostMeter meter;
+
+	for (int i = 0; i < ROUNDS; i++) {
+		std::vector<ListResultItem_t> results;
+		CreateFilteredList(&results, 0, 0);
+	}
+
+	return meter.PerRound();
+}
+
+// What EIO_Find does now
+Cost_t SharedFind() {
+	CostMeter meter;
+
+	for (int i = 0; i < ROUNDS; i++) {
+		std::shared_ptr<const DeviceSnapshot_t> snapshot = GetDeviceSnapshot();
+		DeviceRecordList_t results;
+		CreateFilteredRecordList(snapshot.get(), &results, 0, 0);
+	}
+
+	return meter.PerRound();
+}
+
+void Deliver(const std::shared_ptr<const ListResultItem_t>& record, bool isAdded) {
+	DeviceEvent_t event;
+	event.record = record;
+	event.isAdded = isAdded;
+	queue.Push(event);
+
+	DeviceEvent_t delivered;
+	queue.Pop(&delivered, 1);
+}
+
+DeviceItem_t* CreateHotplugItem() {
+	DeviceItem_t* item = new DeviceItem_t();
+	item->deviceParams.vendorId = 0x9999;
+	item->deviceParams.deviceName = "Synthetic USB Device";
+
+	return item;
+}
+
+// Queues a copy the caller owns, the way events used to carry a raw
+// pointer: the empty owner makes the shared_ptr free to create
+void DeliverCopy(ListResultItem_t* copy, bool isAdded) {
+	Deliver(std::shared_ptr<const ListResultItem_t>(std::shared_ptr<void>(), copy), isAdded);
+	delete copy;
+}
+
+// One device plugged in and out, with a copy of the device per event
+Cost_t CopiedHotplug() {
+	char key[] = "/dev/bus/usb/999/001";
+	CostMeter meter;
+
+	for (int i = 0; i < ROUNDS; i++) {
+		DeviceItem_t* item = CreateHotplugItem();
+		AddItemToList(key, item);
+		DeliverCopy(CopyElement(&item->deviceParams), true);
+
+		DeviceItem_t* stored = GetItemFromList(key);
+		ListResultItem_t* removed = CopyElement(&stored->deviceParams);
+		RemoveItemFromList(stored);
+		delete stored;
+		DeliverCopy(removed, false);
+	}
+
+	return meter.PerRound();
+}
+
+// The same with the events sharing the list's record, as DeviceAdded and
+// DeviceRemoved in the Linux backend do
+Cost_t SharedHotplug() {
+	char key[] = "/dev/bus/usb/999/001";
+	CostMeter meter;
+
+	for (int i = 0; i < ROUNDS; i++) {
+		DeviceItem_t* item = CreateHotplugItem();
+		Deliver(AddItemToList(key, item), true);
+
+		DeviceItem_t* stored = GetItemFromList(key);
+		std::shared_ptr<const ListResultItem_t> removed = RemoveItemFromList(stored);
+		delete stored;
+		Deliver(removed, false);
+	}
+
+	return meter.PerRound();
+}
+
+void PrintCosts(const char* name, Cost_t copied, Cost_t shared) {
+	printf("%16s %12.1f %12.0f %12.1f %12.0f\n", name, copied.allocations, copied.bytes, shared.allocations, shared.bytes);
+}
+
+int main() {
+	const int sizes[] = { 10, 1000 };
+
+	printf("%16s %12s %12s %12s %12s\n", "", "copied", "copied", "shared", "shared");
+	printf("%16s %12s %12s %12s %12s\n", "", "allocs", "bytes", "allocs", "bytes");
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		Populate(sizes[s]);
+
+		// Warm the pools and the queue up so we measure the steady state
+		CopiedHotplug();
+		SharedHotplug();
+
+		char name[32];
+		snprintf(name, sizeof(name), "find %d", sizes[s]);
+		PrintCosts(name, CopiedFind(), SharedFind());
+		snprintf(name, sizeof(name), "hotplug %d", sizes[s]);
+		PrintCosts(name, CopiedHotplug(), SharedHotplug());
+
+		Clear(sizes[s]);
+	}
+
+	return 0;
+}
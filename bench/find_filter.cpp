@@ -0,0 +1,95 @@
+// Compares filtered finds through the vendor/product indexes against a
+// full walk of the device list, at several list sizes.
+
+#include <chrono>
+#include <stdio.h>
+
+#include "deviceList.h"
+
+#define VENDOR_COUNT 50
+#define DONGLE_VENDOR 0x9999
+#define DONGLE_PRODUCT 0x0001
+#define DONGLE_COUNT 2
+
+// What CreateFilteredList did before the indexes existed
+void LinearFilteredList(std::vector<ListResultItem_t>* filteredList, int vid, int pid) {
+	std::shared_ptr<const DeviceSnapshot_t> current = GetDeviceSnapshot();
+
+	for (int i = 0; i < DEVICE_LIST_SHARD_COUNT; i++) {
+		if (!current->shards[i]) {
+			continue;
+		}
+
+		DeviceRecordMap_t::const_iterator it;
+		for (it = current->shards[i]->devices.begin(); it != current->shards[i]->devices.end(); ++it) {
+			const ListResultItem_t* item = it->second.get();
+
+			if (
+				((	vid != 0 && pid != 0) && (vid == item->vendorId && pid == item->productId))
+				|| 	((vid != 0 && pid == 0) && vid == item->vendorId)
+				||	(vid == 0 && pid == 0)
+			) {
+				filteredList->push_back(*item);
+			}
+		}
+	}
+}
+
+void Populate(int count) {
+	char key[32];
+	for (int i = 0; i < count; i++) {
+		DeviceItem_t* item = new DeviceItem_t();
+		bool isDongle = i < DONGLE_COUNT;
+		item->deviceParams.vendorId = isDongle ? DONGLE_VENDOR : (i % VENDOR_COUNT) + 1;
+		item->deviceParams.productId = isDongle ? DONGLE_PRODUCT : i;
+		item->deviceParams.deviceName = "Synthetic device";
+
+		snprintf(key, sizeof(key), "/dev/bus/usb/%d", i);
+		AddItemToList(key, item);
+	}
+}
+
+void Clear(int count) {
+	char key[32];
+	for (int i = 0; i < count; i++) {
+		snprintf(key, sizeof(key), "/dev/bus/usb/%d", i);
+		DeviceItem_t* item = GetItemFromList(key);
+		RemoveItemFromList(item);
+		delete item;
+	}
+}
+
+double NanosecondsPerFind(void (*find)(std::vector<ListResultItem_t>*, int, int), int vid, int pid, int iterations) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < iterations; i++) {
+		std::vector<ListResultItem_t> results;
+		find(&results, vid, pid);
+	}
+
+	std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+	return (double) elapsed.count() / iterations;
+}
+
+int main() {
+	const int sizes[] = { 10, 1000, 10000 };
+	const int iterations = 20000;
+
+	printf("%8s  %-14s %14s %14s %8s\n", "devices", "query", "linear ns", "indexed ns", "speedup");
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		Populate(sizes[s]);
+
+		double linearVid = NanosecondsPerFind(LinearFilteredList, DONGLE_VENDOR, 0, iterations);
+		double indexedVid = NanosecondsPerFind(CreateFilteredList, DONGLE_VENDOR, 0, iterations);
+		double linearProduct = NanosecondsPerFind(LinearFilteredList, DONGLE_VENDOR, DONGLE_PRODUCT, iterations);
+		double indexedProduct = NanosecondsPerFind(CreateFilteredList, DONGLE_VENDOR, DONGLE_PRODUCT, iterations);
+
+		printf("%8d  %-14s %14.0f %14.0f %7.1fx\n", sizes[s], "find(vid)", linearVid, indexedVid, linearVid / indexedVid);
+		printf("%8d  %-14s %14.0f %14.0f %7.1fx\n", sizes[s], "find(vid, pid)", linearProduct, indexedProduct, linearProduct / indexedProduct);
+
+		Clear(sizes[s]);
+	}
+
+	return 0;
+}
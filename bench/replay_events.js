@@ -0,0 +1,102 @@
+// Measures end-to-end hotplug throughput and latency, from the event
+// source to the JS batch callback, against the replay build of the addon.
+//
+// A generated replay file is played back twice, in a fresh process each
+// time: once as fast as possible for throughput and once paced at
+// LATENCY_RATE events/s for latency. Latency is taken from add events,
+// which carry the time they left the source in `locationId`.
+
+var childProcess = require('child_process');
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+
+var DEVICES = 50000;
+var CONNECTED = 64;
+var LATENCY_RATE = 20000;
+
+function generateReplayFile(file) {
+	var lines = [];
+	var record = function(action, i) {
+		var vendorId = ((i % 50) + 1).toString(16);
+		var productId = (i % 0xffff).toString(16);
+		return action + ' /dev/bus/usb/replay/' + i + ' ' + vendorId + ' ' + productId + ' Replay_USB_Device Replay_Devices_Inc. 0123456789';
+	};
+
+	for(var i = 0; i < DEVICES; i++) {
+		lines.push(record('add', i));
+		if(i >= CONNECTED) {
+			lines.push(record('remove', i - CONNECTED));
+		}
+	}
+	for(var j = DEVICES - CONNECTED; j < DEVICES; j++) {
+		lines.push(record('remove', j));
+	}
+
+	fs.writeFileSync(file, lines.join('\n') + '\n');
+}
+
+function percentile(sorted, p) {
+	return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+function run(rate) {
+	var total = DEVICES * 2;
+	var received = 0;
+	var latencies = [];
+	var start;
+
+	var detection = require('./build/Release/detection_replay.node');
+	detection.registerBatch(function(changes) {
+		var time = process.hrtime();
+		var now = Math.floor(time[0] * 1e6 + time[1] / 1e3) % 0x80000000;
+
+		changes.forEach(function(change) {
+			if(change.type === 'add') {
+				latencies.push((now - change.device.locationId + 0x80000000) % 0x80000000);
+			}
+		});
+
+		received += changes.length;
+		if(received < total) {
+			return;
+		}
+
+		var elapsed = process.hrtime(start);
+		var seconds = elapsed[0] + elapsed[1] / 1e9;
+		latencies.sort(function(a, b) { return a - b; });
+
+		if(rate === 0) {
+			console.log('throughput: ' + Math.round(total / seconds) + ' events/s');
+		}
+		else {
+			console.log('latency at ' + rate + ' events/s: p50 ' + percentile(latencies, 0.5) + ' us, p99 ' + percentile(latencies, 0.99) + ' us, max ' + latencies[latencies.length - 1] + ' us');
+		}
+
+		detection.stopMonitoring();
+	});
+
+	// Starting monitoring brings the backend up, and with it the playback
+	start = process.hrtime();
+	detection.startMonitoring();
+}
+
+if(process.env.USB_DETECTION_REPLAY) {
+	run(Number(process.env.USB_DETECTION_REPLAY_RATE));
+}
+else {
+	var file = path.join(os.tmpdir(), 'usb-detection-replay-' + process.pid + '.txt');
+	generateReplayFile(file);
+
+	[0, LATENCY_RATE].forEach(function(rate) {
+		childProcess.execFileSync(process.execPath, [__filename], {
+			stdio: 'inherit',
+			env: Object.assign({}, process.env, {
+				USB_DETECTION_REPLAY: file,
+				USB_DETECTION_REPLAY_RATE: String(rate)
+			})
+		});
+	});
+
+	fs.unlinkSync(file);
+}
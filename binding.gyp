@@ -5,10 +5,16 @@
       "sources": [
         "src/detection.cpp",
         "src/detection.h",
-        "src/deviceList.cpp"
+        "src/detectionStats.cpp",
+        "src/deviceInterest.cpp",
+        "src/deviceList.cpp",
+        "src/eventDebouncer.cpp",
+        "src/eventQueue.cpp",
+        "src/internedString.cpp",
+        "src/subscriptionTable.cpp"
       ],
-      "include_dirs" : [
-        "<!(node -e \"require('nan')\")"
+      "defines": [
+        "NAPI_VERSION=4"
       ],
       'conditions': [
         ['OS=="win"',
@@ -40,11 +46,16 @@
         ['OS=="linux"',
           {
             'sources': [
-              "src/detection_linux.cpp"
+              "src/detection_linux.cpp",
+              "src/registrySnapshot.cpp",
+              "src/replayEventSource.cpp",
+              "src/sharedRegistry.cpp",
+              "src/udevEventSource.cpp"
             ],
             'link_settings': {
               'libraries': [
-                '-ludev'
+                '-ludev',
+                '-lrt'
               ]
             }
           }
@@ -16,6 +16,25 @@ if (global[index.name] && global[index.name].version === index.version) {
 		maxListeners: 1000 // default would be 10!
 	});
 
+	// Nothing native is set up until the device list or events are
+	// actually needed, so merely requiring the module costs nothing.
+	// The initial device list is then built off the main thread, and
+	// `ready` resolves once it is complete.
+	var ready = null;
+	var whenReady = function() {
+		if(!ready) {
+			ready = new Promise(function(resolve) {
+				detection.registerReady(resolve);
+			});
+		}
+
+		return ready;
+	};
+
+	Object.defineProperty(detector, 'ready', {
+		get: whenReady
+	});
+
 	//detector.find = detection.find;
 	detector.find = function(vid, pid, callback) {
 		// Suss out the optional parameters
@@ -55,12 +74,55 @@ if (global[index.name] && global[index.name].version === index.version) {
 				resolve(devices);
 			});
 
-			// Fire off the `find` function that actually does all of the work
-			detection.find.apply(detection, args);
+			// Fire off the `find` function that actually does all of the work,
+			// once there is a complete list to look through
+			whenReady().then(function() {
+				detection.find.apply(detection, args);
+			});
 		});
 	};
 
-	detection.registerAdded(function(device) {
+	detector.findSync = function(vid, pid) {
+		var args = [];
+		if(vid) {
+			args = args.concat(vid);
+		}
+		if(pid) {
+			args = args.concat(pid);
+		}
+
+		return detection.findSync.apply(detection, args);
+	};
+
+	// Only the listed devices are reported as events, and on Linux the
+	// others never even wake the event loop. `null` reports everything.
+	detector.setInterest = function(filters) {
+		detection.setInterest(filters);
+	};
+
+	// Changes to the same device within `ms` of each other are held back
+	// and collapsed into the net change; 0 turns it off again
+	detector.setDebounce = function(ms) {
+		detection.setDebounce(ms || 0);
+	};
+
+	// How many changes the debounce window has swallowed so far
+	detector.getSuppressedCount = function() {
+		return detection.getSuppressedCount();
+	};
+
+	// Event counters and latency histograms since the module was loaded.
+	// Doesn't start anything, and is cheap enough to poll.
+	detector.getStats = function() {
+		return detection.getStats();
+	};
+
+	detector.changesSince = function(generation) {
+		return detection.changesSince(generation || 0);
+	};
+
+	// Every name a change has ever been emitted under, for the fallback
+	var emitAdded = function(device) {
 		detector.emit('add:' + device.vendorId + ':' + device.productId, device);
 		detector.emit('insert:' + device.vendorId + ':' + device.productId, device);
 		detector.emit('add:' + device.vendorId, device);
@@ -71,9 +133,9 @@ if (global[index.name] && global[index.name].version === index.version) {
 		detector.emit('change:' + device.vendorId + ':' + device.productId, device);
 		detector.emit('change:' + device.vendorId, device);
 		detector.emit('change', device);
-	});
+	};
 
-	detection.registerRemoved(function(device) {
+	var emitRemoved = function(device) {
 		detector.emit('remove:' + device.vendorId + ':' + device.productId, device);
 		detector.emit('remove:' + device.vendorId, device);
 		detector.emit('remove', device);
@@ -81,9 +143,156 @@ if (global[index.name] && global[index.name].version === index.version) {
 		detector.emit('change:' + device.vendorId + ':' + device.productId, device);
 		detector.emit('change:' + device.vendorId, device);
 		detector.emit('change', device);
+	};
+
+	var CHANGE_TYPES = {
+		add: 'add',
+		insert: 'add',
+		remove: 'remove',
+		change: 'change'
+	};
+
+	// `add`, `add:vid` and `add:vid:pid` (and the same for the other
+	// change types) map onto a native subscription. Anything else, like a
+	// wildcard pattern, returns null.
+	var parseEventName = function(eventName) {
+		var parts = eventName.split(':');
+		var type = CHANGE_TYPES[parts[0]];
+		var ids = parts.slice(1);
+
+		if(!type || ids.length > 2 || !ids.every(function(id) { return /^[1-9][0-9]*$/.test(id); })) {
+			return null;
+		}
+
+		return {
+			type: type,
+			vendorId: Number(ids[0] || 0),
+			productId: Number(ids[1] || 0)
+		};
+	};
+
+	// Each event name somebody listens to becomes one native subscription
+	// keyed by its vendor/product id, so JS only ever hears about devices
+	// that have listeners. Wildcard patterns and `onAny` can't be routed
+	// that way; while any are in use every change is emitted under every
+	// name instead, as `emitAdded`/`emitRemoved` do.
+	var listened = {};
+	var routes = {};
+	var fallback = null;
+	var isBatchRouted = false;
+
+	var updateRoutes = function() {
+		var wanted = {};
+		var needsFallback = detector.listenersAny().length > 0;
+
+		Object.keys(listened).forEach(function(eventName) {
+			if(detector.listeners(eventName).length === 0) {
+				delete listened[eventName];
+				return;
+			}
+
+			if(eventName === 'batch') {
+				return;
+			}
+
+			var route = parseEventName(eventName);
+			if(route) {
+				wanted[eventName] = route;
+			}
+			else {
+				needsFallback = true;
+			}
+		});
+
+		if(needsFallback) {
+			wanted = {};
+		}
+
+		Object.keys(routes).forEach(function(eventName) {
+			if(!wanted[eventName]) {
+				detection.unsubscribe(routes[eventName]);
+				delete routes[eventName];
+			}
+		});
+
+		Object.keys(wanted).forEach(function(eventName) {
+			if(routes[eventName] === undefined) {
+				var route = wanted[eventName];
+				routes[eventName] = detection.subscribe(route.type, route.vendorId, route.productId, function(device) {
+					detector.emit(eventName, device);
+				});
+			}
+		});
+
+		if(needsFallback && fallback === null) {
+			fallback = detection.subscribe('change', 0, 0, function(device, type) {
+				if(type === 'add') {
+					emitAdded(device);
+				}
+				else {
+					emitRemoved(device);
+				}
+			});
+		}
+		else if(!needsFallback && fallback !== null) {
+			detection.unsubscribe(fallback);
+			fallback = null;
+		}
+
+		// Every change queued since the last loop turn arrives in a single
+		// native call, before the per-device events
+		var wantsBatch = needsFallback || listened.batch !== undefined;
+		if(wantsBatch !== isBatchRouted) {
+			isBatchRouted = wantsBatch;
+			detection.registerBatch(wantsBatch ? function(changes) {
+				detector.emit('batch', changes);
+			} : null);
+		}
+	};
+
+	// Listening for changes is what starts monitoring. Depending on the
+	// EventEmitter2 version, `once`, `many` and the `prepend` variants
+	// either go through `on` or straight to the internal `_on`/`_onAny`,
+	// so every one of them that exists is wrapped. Wrapping one that ends
+	// up in another wrapped one only updates the routes twice.
+	var ANY_LISTENERS = ['onAny', 'prependAny', '_onAny'];
+
+	['on', 'addListener', 'prependListener', 'once', 'prependOnceListener', 'many', 'prependMany', '_on'].concat(ANY_LISTENERS).forEach(function(name) {
+		var addListener = detector[name];
+		if(typeof addListener !== 'function') {
+			return;
+		}
+
+		detector[name] = function(eventName) {
+			var result = addListener.apply(detector, arguments);
+
+			if(ANY_LISTENERS.indexOf(name) === -1) {
+				listened[Array.isArray(eventName) ? eventName.join(':') : eventName] = true;
+			}
+			updateRoutes();
+			detector.startMonitoring();
+
+			return result;
+		};
 	});
 
-	var started = true;
+	// `once` and `many` listeners take themselves off again through `_off`
+	// in the versions that have it
+	['off', 'removeListener', 'offAny', 'removeAllListeners', '_off'].forEach(function(name) {
+		var removeListener = detector[name];
+		if(typeof removeListener !== 'function') {
+			return;
+		}
+
+		detector[name] = function() {
+			var result = removeListener.apply(detector, arguments);
+			updateRoutes();
+
+			return result;
+		};
+	});
+
+	var started = false;
 
 	detector.startMonitoring = function() {
 		if(started) {
@@ -94,12 +303,11 @@ if (global[index.name] && global[index.name].version === index.version) {
 		detection.startMonitoring();
 	};
 
+	// Also tears the native side down, so a later find or listener starts
+	// over with a fresh device list
 	detector.stopMonitoring = function() {
-		if(!started) {
-			return;
-		}
-
 		started = false;
+		ready = null;
 		detection.stopMonitoring();
 	};
 
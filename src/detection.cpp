@@ -1,4 +1,14 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
 #include "detection.h"
+#include "detectionStats.h"
+#include "deviceInterest.h"
+#include "eventDebouncer.h"
+#include "subscriptionTable.h"
 
 
 #define OBJECT_ITEM_LOCATION_ID "locationId"
@@ -9,222 +19,1483 @@
 #define OBJECT_ITEM_SERIAL_NUMBER "serialNumber"
 #define OBJECT_ITEM_DEVICE_ADDRESS "deviceAddress"
 #define OBJECT_ITEM_MOUNT_PATH "mountPath"
+#define OBJECT_ITEM_BUS_NUMBER "busNumber"
+#define OBJECT_ITEM_PORT_PATH "portPath"
+#define OBJECT_ITEM_SPEED "speed"
+#define OBJECT_ITEM_DEVICE_CLASS "deviceClass"
+#define OBJECT_ITEM_INTERFACE_CLASSES "interfaceClasses"
+
+#define OBJECT_CHANGE_TYPE "type"
+#define OBJECT_CHANGE_DEVICE "device"
+
+#define CHANGE_TYPE_ADDED "add"
+#define CHANGE_TYPE_REMOVED "remove"
+#define CHANGE_TYPE_ANY "change"
+
+#define OBJECT_CHANGESET_GENERATION "generation"
+#define OBJECT_CHANGESET_RESYNC "resync"
+#define OBJECT_CHANGESET_CHANGES "changes"
+#define OBJECT_CHANGESET_DEVICES "devices"
+
+#define STATS_EVENTS "events"
+#define STATS_EVENTS_RECEIVED "received"
+#define STATS_EVENTS_FILTERED "filtered"
+#define STATS_EVENTS_QUEUED "queued"
+#define STATS_EVENTS_QUEUE_OVERFLOWS "queueOverflows"
+#define STATS_EVENTS_DROPPED "dropped"
+#define STATS_EVENTS_DELIVERED "delivered"
+#define STATS_EVENTS_SUPPRESSED "suppressed"
+#define STATS_EVENTS_OVERFLOWS "overflows"
+#define STATS_LATENCY "latency"
+#define STATS_LATENCY_KERNEL_TO_MONITOR "kernelToMonitor"
+#define STATS_LATENCY_MONITOR_TO_QUEUE "monitorToQueue"
+#define STATS_LATENCY_QUEUE_TO_CALLBACK "queueToCallback"
+#define STATS_LATENCY_FIND "find"
+#define STATS_LATENCY_COUNT "count"
+#define STATS_LATENCY_MIN "min"
+#define STATS_LATENCY_MEAN "mean"
+#define STATS_LATENCY_P50 "p50"
+#define STATS_LATENCY_P90 "p90"
+#define STATS_LATENCY_P99 "p99"
+#define STATS_LATENCY_P999 "p999"
+#define STATS_LATENCY_MAX "max"
+#define STATS_REGISTRY "registry"
+#define STATS_REGISTRY_SIZE "size"
+
+#define EVENT_BATCH_SIZE 64
+#define STRING_CACHE_LIMIT 4096
+#define DETAILS_CACHE_LIMIT 1024
+
+typedef enum {
+	Key_LocationId,
+	Key_VendorId,
+	Key_ProductId,
+	Key_DeviceName,
+	Key_Manufacturer,
+	Key_SerialNumber,
+	Key_DeviceAddress,
+	Key_MountPath,
+	Key_BusNumber,
+	Key_PortPath,
+	Key_Speed,
+	Key_DeviceClass,
+	Key_InterfaceClasses,
+	Key_ChangeType,
+	Key_ChangeDevice,
+	Key_ChangeAdded,
+	Key_ChangeRemoved,
+	Key_ChangeSetGeneration,
+	Key_ChangeSetResync,
+	Key_ChangeSetChanges,
+	Key_ChangeSetDevices,
+	Key_Count
+} ObjectKey_t;
+
+const char* objectKeyNames[Key_Count] = {
+	OBJECT_ITEM_LOCATION_ID,
+	OBJECT_ITEM_VENDOR_ID,
+	OBJECT_ITEM_PRODUCT_ID,
+	OBJECT_ITEM_DEVICE_NAME,
+	OBJECT_ITEM_MANUFACTURER,
+	OBJECT_ITEM_SERIAL_NUMBER,
+	OBJECT_ITEM_DEVICE_ADDRESS,
+	OBJECT_ITEM_MOUNT_PATH,
+	OBJECT_ITEM_BUS_NUMBER,
+	OBJECT_ITEM_PORT_PATH,
+	OBJECT_ITEM_SPEED,
+	OBJECT_ITEM_DEVICE_CLASS,
+	OBJECT_ITEM_INTERFACE_CLASSES,
+	OBJECT_CHANGE_TYPE,
+	OBJECT_CHANGE_DEVICE,
+	CHANGE_TYPE_ADDED,
+	CHANGE_TYPE_REMOVED,
+	OBJECT_CHANGESET_GENERATION,
+	OBJECT_CHANGESET_RESYNC,
+	OBJECT_CHANGESET_CHANGES,
+	OBJECT_CHANGESET_DEVICES
+};
+
+// Enough for the longest argument list of any method
+#define ARGUMENTS_MAX 4
+#define PORT_PATH_LENGTH 256
+#define CHANGE_TYPE_LENGTH 16
+
+#define ASYNC_RESOURCE_NAME "usb-detection"
+
+// Methods are ordinary writable properties, like any other function
+#define METHOD_ATTRIBUTES ((napi_property_attributes) (napi_writable | napi_enumerable | napi_configurable))
+
+struct DetectionEnvironment;
+
+// What each of the detail getters is handed, so one function can serve them all
+typedef struct {
+	DetectionEnvironment* environment;
+	ObjectKey_t key;
+} DetailGetter_t;
+
+/*
+ * Everything one Node.js environment (the main thread, or a worker) needs
+ * of its own. JS values only work in the environment that made them and
+ * callbacks have to run on its loop, so none of this can be shared.
+ * Created when the module is loaded into the environment and released by
+ * its cleanup hook.
+ */
+struct DetectionEnvironment {
+	napi_env env;
+	// For the debounce timer, which N-API has no equivalent of
+	uv_loop_t* loop;
+
+	// The property names, in ObjectKey_t order. N-API can't hold on to a
+	// string by itself, so they are kept in an array.
+	napi_ref objectKeys;
+
+	// Makes every device object. The detail getters are defined once on
+	// its prototype instead of on every object.
+	napi_ref deviceConstructor;
+	DetailGetter_t detailGetters[Key_InterfaceClasses - Key_Speed + 1];
+
+	// JS copies of interned strings: their slot in the `stringCache` array,
+	// keyed by interned id. Ids are never reused, so entries can only
+	// become unused, never wrong.
+	napi_ref stringCache;
+	std::unordered_map<unsigned int, uint32_t> stringSlots;
+
+	// ReadDeviceDetails results, keyed by port path and address so a device
+	// plugged back in to the same port is read afresh. Filled in the first
+	// time one of a device's objects is asked and dropped when it is removed.
+	std::unordered_map<std::string, DeviceDetails_t> detailsCache;
+
+	// What async_hooks sees the callbacks below being called from
+	napi_async_context asyncContext;
+
+	// A callback that replaces or unregisters itself is still called
+	// through the handle taken before the call, so it stays alive until it
+	// returns
+	napi_ref addedCallback;
+	napi_ref removedCallback;
+	napi_ref batchCallback;
+	napi_ref readyCallback;
+
+	SubscriptionTable subscriptions;
+	std::unordered_map<unsigned int, napi_ref> subscriptionCallbacks;
+
+	// Read by the monitor thread before it queues anything for us
+	DeviceInterest interest;
+
+	// Off until setDebounce is called. The timer fires when the oldest open
+	// window closes and is unref'd, so pending windows never keep the
+	// process alive on their own.
+	EventDebouncer debouncer;
+	uv_timer_t* debounceTimer;
+
+	// The backend's changes, on their way to this environment's loop. The
+	// threadsafe function only carries the wakeups, and they coalesce, so
+	// everything queued before the loop gets round to it goes out in one
+	// batch. It only holds the loop open while we are started or waiting
+	// for the initial list.
+	DeviceEventQueue events;
+	napi_threadsafe_function wakeup;
+	std::atomic<bool> isWakeupPending;
 
+	// Set by the monitor thread, instead of waiting, when `events` is full.
+	// Nothing more is queued until the JS thread has drained the ring and
+	// worked out what it missed: the change that found it full, then the
+	// difference between the list as that change left it and the list
+	// now. The rest is only touched under environmentsMutex.
+	std::atomic<bool> isOverflowed;
+	DeviceEvent_t overflowEvent;
+	std::shared_ptr<const DeviceSnapshot_t> overflowSnapshot;
+	// The generation that was caught up to, so a change the monitor thread
+	// publishes right after isn't queued on top of it
+	unsigned long resyncedGeneration;
 
-Nan::Callback* addedCallback;
-bool isAddedRegistered = false;
+	// Whether this environment counts towards the backend's users
+	bool isUsingBackend;
+	bool isReady;
+	std::atomic<bool> isRunning;
 
-Nan::Callback* removedCallback;
-bool isRemovedRegistered = false;
+	DetectionEnvironment(napi_env env, uv_loop_t* loop)
+		: env(env), loop(loop), objectKeys(NULL), deviceConstructor(NULL), stringCache(NULL), asyncContext(NULL),
+		addedCallback(NULL), removedCallback(NULL), batchCallback(NULL), readyCallback(NULL), debounceTimer(NULL), wakeup(NULL),
+		isWakeupPending(false), isOverflowed(false), resyncedGeneration(0), isUsingBackend(false), isReady(false), isRunning(false) {}
+};
 
-void RegisterAdded(const v8::FunctionCallbackInfo<v8::Value>& args) {
-	v8::Isolate* isolate = v8::Isolate::GetCurrent();
-	v8::HandleScope scope(isolate);
+// Handles that are only good for one call into the module, looked up once
+// and shared by every object it creates
+typedef struct {
+	napi_value keys[Key_Count];
+	napi_value deviceConstructor;
+	napi_value strings;
+} ObjectHandles_t;
 
-	v8::Local<v8::Function> callback;
+// The arguments a method was called with, and its environment
+typedef struct {
+	DetectionEnvironment* environment;
+	size_t argc;
+	napi_value argv[ARGUMENTS_MAX];
+} Arguments_t;
 
-	if (args.Length() == 0) {
-		return Nan::ThrowTypeError("First argument must be a function");
+// Every loaded environment. The monitor thread holds the lock while it
+// queues a change, so an environment that has been removed never gets
+// another wakeup.
+std::mutex environmentsMutex;
+std::vector<DetectionEnvironment*> environments;
+
+// Serialises bringing the backend up and down between environments
+std::mutex backendMutex;
+int backendUsers = 0;
+int runningEnvironments = 0;
+bool isBackendInitialized = false;
+// Set by NotifyReady from whichever thread built the initial list
+std::atomic<bool> isBackendReady(false);
+
+napi_value ThrowTypeError(napi_env env, const char* message) {
+	napi_throw_type_error(env, NULL, message);
+	return NULL;
+}
+
+// Throws what the last N-API call reported, unless it left an exception
+// of its own (a script that threw, say)
+void ThrowLastError(napi_env env) {
+	// Read first: every N-API call, this check included, overwrites it
+	const napi_extended_error_info* info = NULL;
+	napi_get_last_error_info(env, &info);
+	const char* message = info && info->error_message ? info->error_message : "N-API call failed";
+
+	bool isPending = false;
+	napi_is_exception_pending(env, &isPending);
+	if (!isPending) {
+		napi_throw_error(env, NULL, message);
 	}
+}
 
-	if (args.Length() == 1) {
-		// callback
-		if(!args[0]->IsFunction()) {
-			return Nan::ThrowTypeError("First argument must be a function");
+// For calls that only fail when something is badly wrong: leaves an
+// exception pending and returns `failed` from the calling function
+#define NAPI_CALL(env, call, failed) \
+	do { \
+		if ((call) != napi_ok) { \
+			ThrowLastError(env); \
+			return failed; \
+		} \
+	} while (0)
+
+void GetArguments(napi_env env, napi_callback_info info, Arguments_t* args) {
+	void* data = NULL;
+
+	// Missing arguments come back as undefined; argc is how many were passed
+	args->argc = ARGUMENTS_MAX;
+	napi_get_cb_info(env, info, &args->argc, args->argv, NULL, &data);
+	args->environment = static_cast<DetectionEnvironment*>(data);
+}
+
+bool IsType(napi_env env, napi_value value, napi_valuetype type) {
+	napi_valuetype actual;
+	return napi_typeof(env, value, &actual) == napi_ok && actual == type;
+}
+
+double GetNumber(napi_env env, napi_value value) {
+	double number = 0;
+	napi_get_value_double(env, value, &number);
+	return number;
+}
+
+napi_value CreateNumber(napi_env env, double value) {
+	napi_value number;
+	napi_create_double(env, value, &number);
+	return number;
+}
+
+napi_value GetObjectKey(DetectionEnvironment* environment, ObjectKey_t key) {
+	napi_value keys;
+	napi_value name;
+	napi_get_reference_value(environment->env, environment->objectKeys, &keys);
+	napi_get_element(environment->env, keys, key, &name);
+
+	return name;
+}
+
+void GetObjectHandles(DetectionEnvironment* environment, ObjectHandles_t* handles) {
+	napi_env env = environment->env;
+
+	napi_value keys;
+	napi_get_reference_value(env, environment->objectKeys, &keys);
+	for(int i = 0; i < Key_Count; i++) {
+		napi_get_element(env, keys, i, &handles->keys[i]);
+	}
+
+	napi_get_reference_value(env, environment->deviceConstructor, &handles->deviceConstructor);
+	napi_get_reference_value(env, environment->stringCache, &handles->strings);
+}
+
+napi_value GetCachedString(DetectionEnvironment* environment, ObjectHandles_t* handles, const InternedString& value) {
+	napi_env env = environment->env;
+	napi_value str;
+
+	if(value.empty()) {
+		napi_create_string_utf8(env, "", 0, &str);
+		return str;
+	}
+
+	std::unordered_map<unsigned int, uint32_t>::iterator it = environment->stringSlots.find(value.Id());
+	if(it != environment->stringSlots.end()) {
+		napi_get_element(env, handles->strings, it->second, &str);
+		return str;
+	}
+
+	// Start over with a new array; the old one goes once nothing uses it
+	if(environment->stringSlots.size() >= STRING_CACHE_LIMIT) {
+		napi_delete_reference(env, environment->stringCache);
+		napi_create_array(env, &handles->strings);
+		napi_create_reference(env, handles->strings, 1, &environment->stringCache);
+		environment->stringSlots.clear();
+	}
+
+	uint32_t slot = environment->stringSlots.size();
+	napi_create_string_utf8(env, value.c_str(), value.length(), &str);
+	napi_set_element(env, handles->strings, slot, str);
+	environment->stringSlots[value.Id()] = slot;
+
+	return str;
+}
+
+// Lets go of whatever `ref` held, and holds on to `callback` instead unless it is NULL
+void SetCallback(napi_env env, napi_ref* ref, napi_value callback) {
+	if (*ref != NULL) {
+		napi_delete_reference(env, *ref);
+		*ref = NULL;
+	}
+
+	if (callback != NULL) {
+		napi_create_reference(env, callback, 1, ref);
+	}
+}
+
+// Calls back into JS the way node does from its own loop, so ticks and
+// promise jobs the callback queues run as soon as it returns. What it
+// throws goes to 'uncaughtException', as from any other async callback.
+void MakeCallback(DetectionEnvironment* environment, napi_value callback, size_t argc, const napi_value* argv) {
+	napi_env env = environment->env;
+
+	napi_value global;
+	napi_get_global(env, &global);
+
+	if (napi_make_callback(env, environment->asyncContext, global, callback, argc, argv, NULL) == napi_pending_exception) {
+		napi_value exception;
+		napi_get_and_clear_last_exception(env, &exception);
+		napi_fatal_exception(env, exception);
+	}
+}
+
+std::string GetDetailsKey(const std::string& portPath, int deviceAddress) {
+	return portPath + "#" + std::to_string(deviceAddress);
+}
+
+napi_value GetDeviceDetail(napi_env env, napi_callback_info info) {
+	napi_value device;
+	void* data;
+	napi_get_cb_info(env, info, NULL, NULL, &device, &data);
+
+	DetailGetter_t* getter = static_cast<DetailGetter_t*>(data);
+	DetectionEnvironment* environment = getter->environment;
+
+	napi_value value;
+	char portPath[PORT_PATH_LENGTH];
+	size_t length = 0;
+	napi_get_property(env, device, GetObjectKey(environment, Key_PortPath), &value);
+	if (napi_get_value_string_utf8(env, value, portPath, sizeof(portPath), &length) != napi_ok || length == 0) {
+		return NULL;
+	}
+
+	int deviceAddress = 0;
+	napi_get_property(env, device, GetObjectKey(environment, Key_DeviceAddress), &value);
+	napi_get_value_int32(env, value, &deviceAddress);
+	std::string key = GetDetailsKey(portPath, deviceAddress);
+
+	std::unordered_map<std::string, DeviceDetails_t>::iterator it = environment->detailsCache.find(key);
+	if (it == environment->detailsCache.end()) {
+		DeviceDetails_t details;
+		if (!ReadDeviceDetails(portPath, &details)) {
+			return NULL;
+		}
+
+		if (environment->detailsCache.size() >= DETAILS_CACHE_LIMIT) {
+			environment->detailsCache.clear();
 		}
+		it = environment->detailsCache.insert(std::make_pair(key, details)).first;
+	}
 
-		callback = args[0].As<v8::Function>();
+	const DeviceDetails_t& details = it->second;
+	napi_value result;
+	if (getter->key == Key_Speed) {
+		napi_create_double(env, details.speed, &result);
+	}
+	else if (getter->key == Key_DeviceClass) {
+		napi_create_int32(env, details.deviceClass, &result);
+	}
+	else {
+		napi_create_array_with_length(env, details.interfaceClasses.size(), &result);
+		for (size_t i = 0; i < details.interfaceClasses.size(); i++) {
+			napi_value interfaceClass;
+			napi_create_int32(env, details.interfaceClasses[i], &interfaceClass);
+			napi_set_element(env, result, i, interfaceClass);
+		}
 	}
 
-	addedCallback = new Nan::Callback(callback);
-	isAddedRegistered = true;
+	return result;
 }
 
-void NotifyAdded(ListResultItem_t* it) {
-	v8::Isolate* isolate = v8::Isolate::GetCurrent();
-	v8::HandleScope scope(isolate);
+// Returns false with an exception pending if any of it failed. The
+// references are only taken once everything else has worked, so there is
+// nothing to undo.
+bool InitObjectTemplates(DetectionEnvironment* environment) {
+	napi_env env = environment->env;
 
-	if (isAddedRegistered){
-		v8::Local<v8::Value> argv[1];
-		v8::Local<v8::Object> item = v8::Object::New(isolate);
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_LOCATION_ID), v8::Number::New(isolate, it->locationId));
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_VENDOR_ID), v8::Number::New(isolate, it->vendorId));
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_PRODUCT_ID), v8::Number::New(isolate, it->productId));
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_DEVICE_NAME), v8::String::NewFromUtf8(isolate, it->deviceName.c_str()));
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_MANUFACTURER), v8::String::NewFromUtf8(isolate, it->manufacturer.c_str()));
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_SERIAL_NUMBER), v8::String::NewFromUtf8(isolate, it->serialNumber.c_str()));
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_DEVICE_ADDRESS), v8::Number::New(isolate, it->deviceAddress));
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_MOUNT_PATH),
-                   v8::String::NewFromUtf8(isolate, it->mountPath.c_str()));
+	napi_value keys;
+	NAPI_CALL(env, napi_create_array_with_length(env, Key_Count, &keys), false);
+	for(int i = 0; i < Key_Count; i++) {
+		napi_value name;
+		NAPI_CALL(env, napi_create_string_utf8(env, objectKeyNames[i], NAPI_AUTO_LENGTH, &name), false);
+		NAPI_CALL(env, napi_set_element(env, keys, i, name), false);
+	}
+
+	// Every device object is made by this one constructor, so they all
+	// share one hidden class. Its stores run as JS, which costs far less
+	// than a separate N-API call to set each property.
+	std::string source = "(function (";
+	for(int i = Key_LocationId; i <= Key_PortPath; i++) {
+		source += (i == Key_LocationId ? "v" : ", v") + std::to_string(i);
+	}
+	source += ") {";
+	for(int i = Key_LocationId; i <= Key_PortPath; i++) {
+		source += " this." + std::string(objectKeyNames[i]) + " = v" + std::to_string(i) + ";";
+	}
+	source += " })";
+
+	napi_value script;
+	napi_value constructor;
+	NAPI_CALL(env, napi_create_string_utf8(env, source.c_str(), source.length(), &script), false);
+	NAPI_CALL(env, napi_run_script(env, script, &constructor), false);
 
-		argv[0] = item;
+	// On the prototype and not enumerable, so logging or serialising a
+	// device doesn't read sysfs
+	napi_property_descriptor details[Key_InterfaceClasses - Key_Speed + 1];
+	for(int i = Key_Speed; i <= Key_InterfaceClasses; i++) {
+		DetailGetter_t* getter = &environment->detailGetters[i - Key_Speed];
+		getter->environment = environment;
+		getter->key = (ObjectKey_t) i;
 
-		addedCallback->Call(1, argv);
+		napi_property_descriptor descriptor = { objectKeyNames[i], NULL, NULL, GetDeviceDetail, NULL, NULL, napi_default, getter };
+		details[i - Key_Speed] = descriptor;
 	}
+
+	napi_value prototype;
+	NAPI_CALL(env, napi_get_named_property(env, constructor, "prototype", &prototype), false);
+	NAPI_CALL(env, napi_define_properties(env, prototype, sizeof(details) / sizeof(details[0]), details), false);
+
+	napi_value strings;
+	NAPI_CALL(env, napi_create_array(env, &strings), false);
+
+	napi_create_reference(env, keys, 1, &environment->objectKeys);
+	napi_create_reference(env, constructor, 1, &environment->deviceConstructor);
+	napi_create_reference(env, strings, 1, &environment->stringCache);
+
+	return true;
+}
+
+napi_value CreateDeviceObject(DetectionEnvironment* environment, ObjectHandles_t* handles, const ListResultItem_t* it) {
+	napi_env env = environment->env;
+
+	// In the constructor's argument order
+	napi_value values[Key_PortPath + 1];
+	napi_create_int32(env, it->locationId, &values[Key_LocationId]);
+	napi_create_int32(env, it->vendorId, &values[Key_VendorId]);
+	napi_create_int32(env, it->productId, &values[Key_ProductId]);
+	values[Key_DeviceName] = GetCachedString(environment, handles, it->deviceName);
+	values[Key_Manufacturer] = GetCachedString(environment, handles, it->manufacturer);
+	values[Key_SerialNumber] = GetCachedString(environment, handles, it->serialNumber);
+	napi_create_int32(env, it->deviceAddress, &values[Key_DeviceAddress]);
+	napi_create_string_utf8(env, it->mountPath.c_str(), NAPI_AUTO_LENGTH, &values[Key_MountPath]);
+	napi_create_int32(env, it->busNumber, &values[Key_BusNumber]);
+	values[Key_PortPath] = GetCachedString(environment, handles, it->portPath);
+
+	napi_value item;
+	napi_new_instance(env, handles->deviceConstructor, Key_PortPath + 1, values, &item);
+
+	return item;
 }
 
-void RegisterRemoved(const v8::FunctionCallbackInfo<v8::Value>& args) {
-	v8::Isolate* isolate = v8::Isolate::GetCurrent();
-	v8::HandleScope scope(isolate);
+napi_value CreateChangeObject(DetectionEnvironment* environment, ObjectHandles_t* handles, bool isAdded, const ListResultItem_t* it) {
+	napi_env env = environment->env;
+
+	napi_value change;
+	napi_create_object(env, &change);
+	napi_set_property(env, change, handles->keys[Key_ChangeType], handles->keys[isAdded ? Key_ChangeAdded : Key_ChangeRemoved]);
+	napi_set_property(env, change, handles->keys[Key_ChangeDevice], CreateDeviceObject(environment, handles, it));
+
+	return change;
+}
 
-	v8::Local<v8::Function> callback;
+// Any thread. Wakeups coalesce: if one is already on its way, whatever
+// was queued since goes out with it.
+void WakeEnvironment(DetectionEnvironment* environment) {
+	if (!environment->isWakeupPending.exchange(true)) {
+		napi_call_threadsafe_function(environment->wakeup, NULL, napi_tsfn_nonblocking);
+	}
+}
 
-	if (args.Length() == 0) {
-		return Nan::ThrowTypeError("First argument must be a function");
+// Holds the loop open while this environment is started, or while it
+// waits for the backend's initial list
+void UpdateLoopReference(DetectionEnvironment* environment) {
+	if (environment->isRunning || (environment->isUsingBackend && !environment->isReady)) {
+		napi_ref_threadsafe_function(environment->env, environment->wakeup);
+	}
+	else {
+		napi_unref_threadsafe_function(environment->env, environment->wakeup);
 	}
+}
 
-	if (args.Length() == 1) {
-		// callback
-		if(!args[0]->IsFunction()) {
-			return Nan::ThrowTypeError("First argument must be a function");
+void PublishDeviceEvent(const std::shared_ptr<const ListResultItem_t>& record, bool isAdded, uint64_t receivedAt) {
+	DeviceEvent_t event;
+	event.record = record;
+	event.isAdded = isAdded;
+	event.queuedAt = GetStatsTime();
+
+	bool isQueued = false;
+
+	std::lock_guard<std::mutex> lock(environmentsMutex);
+	for (size_t i = 0; i < environments.size(); i++) {
+		DetectionEnvironment* environment = environments[i];
+
+		// Nobody there is listening for this one, so don't wake it
+		if (!environment->isRunning || !environment->interest.Matches(record->vendorId, record->productId)) {
+			continue;
+		}
+
+		// Its JS thread picks this one up from the list once it catches up
+		if (environment->isOverflowed) {
+			isQueued = true;
+			continue;
+		}
+
+		// Already in the changes it caught up on
+		if (environment->resyncedGeneration != 0) {
+			if (GetDeviceSnapshot()->version <= environment->resyncedGeneration) {
+				continue;
+			}
+			environment->resyncedGeneration = 0;
+		}
+
+		// Never waits on a full ring, so one environment that has fallen
+		// behind doesn't hold up the others
+		if (!environment->events.Push(event)) {
+			detectionStats.queueOverflows++;
+			environment->overflowEvent = event;
+			environment->overflowSnapshot = GetDeviceSnapshot();
+			environment->isOverflowed = true;
 		}
 
-		callback = args[0].As<v8::Function>();
+		isQueued = true;
+		WakeEnvironment(environment);
 	}
 
-	removedCallback = new Nan::Callback(callback);
-	isRemovedRegistered = true;
+	if (!isQueued) {
+		detectionStats.filtered++;
+		return;
+	}
+
+	detectionStats.monitorToQueue.Record(event.queuedAt - receivedAt);
+	detectionStats.queued++;
+}
+
+void NotifyAdded(ListResultItem_t* it) {
+	PublishDeviceEvent(CreateRecord(*it), true, GetStatsTime());
 }
 
 void NotifyRemoved(ListResultItem_t* it) {
-	v8::Isolate* isolate = v8::Isolate::GetCurrent();
-	v8::HandleScope scope(isolate);
+	PublishDeviceEvent(CreateRecord(*it), false, GetStatsTime());
+}
+
+void NotifyReady() {
+	isBackendReady = true;
+
+	// Each environment calls its ready callback on its own loop
+	std::lock_guard<std::mutex> lock(environmentsMutex);
+	for (size_t i = 0; i < environments.size(); i++) {
+		WakeEnvironment(environments[i]);
+	}
+}
+
+napi_value RegisterAdded(napi_env env, napi_callback_info info) {
+	Arguments_t args;
+	GetArguments(env, info, &args);
+
+	if (args.argc == 0 || !IsType(env, args.argv[0], napi_function)) {
+		return ThrowTypeError(env, "First argument must be a function");
+	}
+
+	SetCallback(env, &args.environment->addedCallback, args.argv[0]);
+
+	return NULL;
+}
+
+napi_value RegisterRemoved(napi_env env, napi_callback_info info) {
+	Arguments_t args;
+	GetArguments(env, info, &args);
+
+	if (args.argc == 0 || !IsType(env, args.argv[0], napi_function)) {
+		return ThrowTypeError(env, "First argument must be a function");
+	}
+
+	SetCallback(env, &args.environment->removedCallback, args.argv[0]);
+
+	return NULL;
+}
 
-	if (isRemovedRegistered) {
-		v8::Local<v8::Value> argv[1];
-		v8::Local<v8::Object> item = v8::Object::New(isolate);
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_LOCATION_ID), v8::Number::New(isolate, it->locationId));
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_VENDOR_ID), v8::Number::New(isolate, it->vendorId));
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_PRODUCT_ID), v8::Number::New(isolate, it->productId));
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_DEVICE_NAME), v8::String::NewFromUtf8(isolate, it->deviceName.c_str()));
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_MANUFACTURER), v8::String::NewFromUtf8(isolate, it->manufacturer.c_str()));
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_SERIAL_NUMBER), v8::String::NewFromUtf8(isolate, it->serialNumber.c_str()));
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_DEVICE_ADDRESS), v8::Number::New(isolate, it->deviceAddress));
-		item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_MOUNT_PATH),
-                   v8::String::NewFromUtf8(isolate, it->mountPath.c_str()));
-		argv[0] = item;
+napi_value RegisterBatch(napi_env env, napi_callback_info info) {
+	Arguments_t args;
+	GetArguments(env, info, &args);
 
-		removedCallback->Call(1, argv);
+	bool isNull = args.argc > 0 && IsType(env, args.argv[0], napi_null);
+	if (args.argc == 0 || !(IsType(env, args.argv[0], napi_function) || isNull)) {
+		return ThrowTypeError(env, "First argument must be a function or null");
 	}
+
+	SetCallback(env, &args.environment->batchCallback, isNull ? NULL : args.argv[0]);
+
+	return NULL;
 }
 
-void Find(const v8::FunctionCallbackInfo<v8::Value>& args) {
-	v8::Isolate* isolate = v8::Isolate::GetCurrent();
-	v8::HandleScope scope(isolate);
+napi_value Subscribe(napi_env env, napi_callback_info info) {
+	Arguments_t args;
+	GetArguments(env, info, &args);
+	DetectionEnvironment* environment = args.environment;
+
+	if (args.argc < 4 || !IsType(env, args.argv[0], napi_string) || !IsType(env, args.argv[1], napi_number) || !IsType(env, args.argv[2], napi_number) || !IsType(env, args.argv[3], napi_function)) {
+		return ThrowTypeError(env, "Arguments must be a change type, vendor id, product id and function");
+	}
+
+	char type[CHANGE_TYPE_LENGTH];
+	napi_get_value_string_utf8(env, args.argv[0], type, sizeof(type), NULL);
+	int changeMask = 0;
+	if (strcmp(type, CHANGE_TYPE_ADDED) == 0) {
+		changeMask = CHANGE_MASK_ADDED;
+	}
+	else if (strcmp(type, CHANGE_TYPE_REMOVED) == 0) {
+		changeMask = CHANGE_MASK_REMOVED;
+	}
+	else if (strcmp(type, CHANGE_TYPE_ANY) == 0) {
+		changeMask = CHANGE_MASK_ADDED | CHANGE_MASK_REMOVED;
+	}
+	else {
+		return ThrowTypeError(env, "Change type must be 'add', 'remove' or 'change'");
+	}
+
+	int vid = (int) GetNumber(env, args.argv[1]);
+	int pid = (int) GetNumber(env, args.argv[2]);
+	if (vid == 0 && pid != 0) {
+		return ThrowTypeError(env, "A product id needs a vendor id");
+	}
+
+	unsigned int id = environment->subscriptions.Add(vid, pid, changeMask);
+	napi_ref callback = NULL;
+	SetCallback(env, &callback, args.argv[3]);
+	environment->subscriptionCallbacks[id] = callback;
+
+	return CreateNumber(env, id);
+}
+
+napi_value Unsubscribe(napi_env env, napi_callback_info info) {
+	Arguments_t args;
+	GetArguments(env, info, &args);
+	DetectionEnvironment* environment = args.environment;
+
+	if (args.argc == 0 || !IsType(env, args.argv[0], napi_number)) {
+		return ThrowTypeError(env, "First argument must be a subscription id");
+	}
+
+	unsigned int id = (unsigned int) GetNumber(env, args.argv[0]);
+	environment->subscriptions.Remove(id);
+
+	std::unordered_map<unsigned int, napi_ref>::iterator it = environment->subscriptionCallbacks.find(id);
+	if (it != environment->subscriptionCallbacks.end()) {
+		napi_delete_reference(env, it->second);
+		environment->subscriptionCallbacks.erase(it);
+	}
+
+	return NULL;
+}
+
+void DeliverEvents(DetectionEnvironment* environment, const std::vector<DeviceEvent_t>& interesting) {
+	napi_env env = environment->env;
+
+	napi_handle_scope scope;
+	napi_open_handle_scope(env, &scope);
+
+	ObjectHandles_t handles;
+	GetObjectHandles(environment, &handles);
+
+	// Every consumer of a change gets the same device object, built the
+	// first time one is needed
+	std::vector<napi_value> devices(interesting.size(), NULL);
+
+	// Held for the duration of the call, in case it unregisters itself
+	if (environment->batchCallback != NULL) {
+		napi_value batch;
+		napi_get_reference_value(env, environment->batchCallback, &batch);
+
+		napi_value argv[1];
+		napi_create_array_with_length(env, interesting.size(), &argv[0]);
+
+		for(size_t i = 0; i < interesting.size(); i++) {
+			napi_value change = CreateChangeObject(environment, &handles, interesting[i].isAdded, interesting[i].record.get());
+			napi_get_property(env, change, handles.keys[Key_ChangeDevice], &devices[i]);
+			napi_set_element(env, argv[0], i, change);
+		}
+
+		MakeCallback(environment, batch, 1, argv);
+	}
+
+	std::vector<unsigned int> ids;
+	for(size_t i = 0; i < interesting.size(); i++) {
+		const ListResultItem_t* it = interesting[i].record.get();
+		bool isAdded = interesting[i].isAdded;
+		napi_ref changeCallback = isAdded ? environment->addedCallback : environment->removedCallback;
+
+		ids.clear();
+		environment->subscriptions.Match(it->vendorId, it->productId, isAdded ? CHANGE_MASK_ADDED : CHANGE_MASK_REMOVED, &ids);
+
+		if (ids.empty() && changeCallback == NULL) {
+			continue;
+		}
+
+		if (devices[i] == NULL) {
+			devices[i] = CreateDeviceObject(environment, &handles, it);
+		}
+
+		napi_value argv[2];
+		argv[0] = devices[i];
+		argv[1] = handles.keys[isAdded ? Key_ChangeAdded : Key_ChangeRemoved];
+
+		// The change callback as it was before any subscription got to run
+		napi_value onChange = NULL;
+		if (changeCallback != NULL) {
+			napi_get_reference_value(env, changeCallback, &onChange);
+		}
+
+		for(size_t j = 0; j < ids.size(); j++) {
+			// An earlier callback may have unsubscribed this one
+			std::unordered_map<unsigned int, napi_ref>::iterator found = environment->subscriptionCallbacks.find(ids[j]);
+			if (found == environment->subscriptionCallbacks.end()) {
+				continue;
+			}
+
+			napi_value callback;
+			napi_get_reference_value(env, found->second, &callback);
+			MakeCallback(environment, callback, 2, argv);
+		}
+
+		if (onChange != NULL) {
+			MakeCallback(environment, onChange, 1, argv);
+		}
+	}
+
+	napi_close_handle_scope(env, scope);
+}
+
+void DebounceTimerCallback(uv_timer_t* handle);
+
+void FlushDebouncedEvents(DetectionEnvironment* environment, uint64_t now) {
+	std::vector<DeviceEvent_t> ready;
+	environment->debouncer.Flush(now, &ready);
+
+	if (environment->debouncer.HasPending()) {
+		uint64_t deadline = environment->debouncer.NextDeadline();
+		uv_timer_start(environment->debounceTimer, DebounceTimerCallback, deadline > now ? deadline - now : 0, 0);
+	}
+
+	if (!ready.empty()) {
+		DeliverEvents(environment, ready);
+	}
+}
+
+void DebounceTimerCallback(uv_timer_t* handle) {
+	FlushDebouncedEvents(static_cast<DetectionEnvironment*>(handle->data), uv_now(handle->loop));
+}
+
+// Hands a set of changes to the batch callback, then to each matching
+// subscription and the added/removed callbacks
+void NotifyEvents(DetectionEnvironment* environment, DeviceEvent_t* events, size_t count) {
+	// The interest may have been narrowed since these were queued
+	std::vector<DeviceEvent_t> interesting;
+	interesting.reserve(count);
+	for(size_t i = 0; i < count; i++) {
+		if (!events[i].isAdded && !environment->detailsCache.empty()) {
+			environment->detailsCache.erase(GetDetailsKey(events[i].record->portPath.c_str(), events[i].record->deviceAddress));
+		}
+
+		if (environment->interest.Matches(events[i].record->vendorId, events[i].record->productId)) {
+			interesting.push_back(events[i]);
+		}
+	}
+
+	if (interesting.empty()) {
+		return;
+	}
+
+	if (environment->debouncer.GetWindow() == 0) {
+		DeliverEvents(environment, interesting);
+		return;
+	}
+
+	// The debouncer holds on to the records until their window closes
+	bool wasPending = environment->debouncer.HasPending();
+	uint64_t now = uv_now(environment->loop);
+	for(size_t i = 0; i < interesting.size(); i++) {
+		environment->debouncer.Add(interesting[i], now);
+	}
+
+	if (!wasPending) {
+		uv_timer_start(environment->debounceTimer, DebounceTimerCallback, environment->debouncer.NextDeadline() - now, 0);
+	}
+}
+
+// The monitor thread stopped queueing for the environment when its ring
+// filled up. Works out what it missed from the device list and lets it
+// queue again.
+void AppendMissedEvents(DetectionEnvironment* environment, std::vector<DeviceEvent_t>* events) {
+	DeviceEvent_t first;
+	std::shared_ptr<const DeviceSnapshot_t> from;
+	std::shared_ptr<const DeviceSnapshot_t> to;
+	{
+		std::lock_guard<std::mutex> lock(environmentsMutex);
+		first = environment->overflowEvent;
+		from = environment->overflowSnapshot;
+		to = GetDeviceSnapshot();
+
+		environment->overflowEvent.record.reset();
+		environment->overflowSnapshot.reset();
+		environment->resyncedGeneration = to->version;
+		environment->isOverflowed = false;
+	}
+
+	// Compared outside the lock so the monitor thread can carry on
+	std::vector<DeviceChange_t> changes;
+	GetChangesBetween(from.get(), to.get(), &changes);
+
+	events->push_back(first);
+	uint64_t now = GetStatsTime();
+	for (size_t i = 0; i < changes.size(); i++) {
+		DeviceEvent_t event;
+		event.record = changes[i].record;
+		event.isAdded = changes[i].isAdded;
+		event.queuedAt = now;
+		events->push_back(event);
+	}
+}
+
+// The threadsafe function's call_js: runs on the environment's loop for
+// each wakeup, with `env` NULL when node is tearing it down instead
+void ProcessEnvironmentEvents(napi_env env, napi_value callback, void* context, void* data) {
+	if (env == NULL) {
+		return;
+	}
+
+	DetectionEnvironment* environment = static_cast<DetectionEnvironment*>(context);
+	DeviceEvent_t buffer[EVENT_BATCH_SIZE];
+	std::vector<DeviceEvent_t> events;
+	size_t count;
+
+	// Anything queued from here on needs a wakeup of its own
+	environment->isWakeupPending = false;
+
+	// Devices enumerated at startup are in the list before any event
+	// that follows them is delivered
+	if (environment->isUsingBackend && !environment->isReady && isBackendReady) {
+		environment->isReady = true;
+		UpdateLoopReference(environment);
+
+		if (environment->readyCallback != NULL) {
+			napi_value ready;
+			napi_get_reference_value(env, environment->readyCallback, &ready);
+			MakeCallback(environment, ready, 0, NULL);
+		}
+	}
+
+	// Drain at most one ring's worth per wakeup so a steady stream of
+	// events can't starve the rest of the loop
+	while(events.size() < environment->events.Capacity() && (count = environment->events.Pop(buffer, EVENT_BATCH_SIZE)) > 0) {
+		events.insert(events.end(), buffer, buffer + count);
+	}
+
+	// What was left out while the ring was full comes after what it held
+	if (environment->isOverflowed && environment->events.IsEmpty()) {
+		AppendMissedEvents(environment, &events);
+	}
+
+	if (environment->isRunning && !events.empty()) {
+		uint64_t now = GetStatsTime();
+		for(size_t i = 0; i < events.size(); i++) {
+			detectionStats.queueToCallback.Record(now - events[i].queuedAt);
+		}
+		detectionStats.delivered += events.size();
+
+		// Everything queued since the last loop turn goes out in one call
+		NotifyEvents(environment, &events[0], events.size());
+	}
+	else {
+		detectionStats.dropped += events.size();
+	}
+
+	if(!environment->events.IsEmpty()) {
+		WakeEnvironment(environment);
+	}
+}
+
+napi_value SetDebounce(napi_env env, napi_callback_info info) {
+	Arguments_t args;
+	GetArguments(env, info, &args);
+	DetectionEnvironment* environment = args.environment;
+
+	if (args.argc == 0 || !IsType(env, args.argv[0], napi_number) || GetNumber(env, args.argv[0]) < 0) {
+		return ThrowTypeError(env, "First argument must be a window in milliseconds");
+	}
+
+	environment->debouncer.SetWindow((uint64_t) GetNumber(env, args.argv[0]));
+
+	// Turning it off lets whatever is still held through right away
+	if (environment->debouncer.GetWindow() == 0 && environment->debouncer.HasPending()) {
+		uv_timer_stop(environment->debounceTimer);
+		FlushDebouncedEvents(environment, UINT64_MAX);
+	}
+
+	return NULL;
+}
+
+napi_value GetSuppressedCount(napi_env env, napi_callback_info info) {
+	Arguments_t args;
+	GetArguments(env, info, &args);
+
+	return CreateNumber(env, (double) args.environment->debouncer.SuppressedCount());
+}
+
+napi_value CreateLatencyObject(napi_env env, const LatencyHistogram& histogram) {
+	LatencySummary_t summary;
+	histogram.Summarize(&summary);
+
+	napi_value latency;
+	napi_create_object(env, &latency);
+	napi_set_named_property(env, latency, STATS_LATENCY_COUNT, CreateNumber(env, (double) summary.count));
+	napi_set_named_property(env, latency, STATS_LATENCY_MIN, CreateNumber(env, (double) summary.min));
+	napi_set_named_property(env, latency, STATS_LATENCY_MEAN, CreateNumber(env, summary.mean));
+	napi_set_named_property(env, latency, STATS_LATENCY_P50, CreateNumber(env, (double) summary.p50));
+	napi_set_named_property(env, latency, STATS_LATENCY_P90, CreateNumber(env, (double) summary.p90));
+	napi_set_named_property(env, latency, STATS_LATENCY_P99, CreateNumber(env, (double) summary.p99));
+	napi_set_named_property(env, latency, STATS_LATENCY_P999, CreateNumber(env, (double) summary.p999));
+	napi_set_named_property(env, latency, STATS_LATENCY_MAX, CreateNumber(env, (double) summary.max));
+
+	return latency;
+}
+
+napi_value GetStats(napi_env env, napi_callback_info info) {
+	Arguments_t args;
+	GetArguments(env, info, &args);
+
+	// The counters are the whole process's; only suppressed is this
+	// environment's own
+	napi_value events;
+	napi_create_object(env, &events);
+	napi_set_named_property(env, events, STATS_EVENTS_RECEIVED, CreateNumber(env, (double) detectionStats.received));
+	napi_set_named_property(env, events, STATS_EVENTS_FILTERED, CreateNumber(env, (double) detectionStats.filtered));
+	napi_set_named_property(env, events, STATS_EVENTS_QUEUED, CreateNumber(env, (double) detectionStats.queued));
+	napi_set_named_property(env, events, STATS_EVENTS_QUEUE_OVERFLOWS, CreateNumber(env, (double) detectionStats.queueOverflows));
+	napi_set_named_property(env, events, STATS_EVENTS_DROPPED, CreateNumber(env, (double) detectionStats.dropped));
+	napi_set_named_property(env, events, STATS_EVENTS_DELIVERED, CreateNumber(env, (double) detectionStats.delivered));
+	napi_set_named_property(env, events, STATS_EVENTS_SUPPRESSED, CreateNumber(env, (double) args.environment->debouncer.SuppressedCount()));
+	napi_set_named_property(env, events, STATS_EVENTS_OVERFLOWS, CreateNumber(env, (double) detectionStats.overflows));
+
+	napi_value latency;
+	napi_create_object(env, &latency);
+	napi_set_named_property(env, latency, STATS_LATENCY_KERNEL_TO_MONITOR, CreateLatencyObject(env, detectionStats.kernelToMonitor));
+	napi_set_named_property(env, latency, STATS_LATENCY_MONITOR_TO_QUEUE, CreateLatencyObject(env, detectionStats.monitorToQueue));
+	napi_set_named_property(env, latency, STATS_LATENCY_QUEUE_TO_CALLBACK, CreateLatencyObject(env, detectionStats.queueToCallback));
+	napi_set_named_property(env, latency, STATS_LATENCY_FIND, CreateLatencyObject(env, detectionStats.find));
+
+	// Doesn't bring the backend up; an empty list reads as zero
+	std::shared_ptr<const DeviceSnapshot_t> snapshot = GetDeviceSnapshot();
+	napi_value registry;
+	napi_create_object(env, &registry);
+	napi_set_named_property(env, registry, STATS_REGISTRY_SIZE, CreateNumber(env, (double) snapshot->size));
+	napi_set_named_property(env, registry, OBJECT_CHANGESET_GENERATION, CreateNumber(env, (double) snapshot->version));
+
+	napi_value stats;
+	napi_create_object(env, &stats);
+	napi_set_named_property(env, stats, STATS_EVENTS, events);
+	napi_set_named_property(env, stats, STATS_LATENCY, latency);
+	napi_set_named_property(env, stats, STATS_REGISTRY, registry);
+
+	return stats;
+}
+
+// The backend is only brought up once something actually needs it, and
+// stays up while any environment does
+void EnsureDetection(DetectionEnvironment* environment) {
+	if (environment->isUsingBackend) {
+		return;
+	}
+
+	environment->isUsingBackend = true;
+	environment->isReady = false;
+	UpdateLoopReference(environment);
+
+	std::lock_guard<std::mutex> lock(backendMutex);
+	backendUsers++;
+	if (!isBackendInitialized) {
+		isBackendInitialized = true;
+		InitDetection();
+	}
+}
+
+void ReleaseDetection(DetectionEnvironment* environment) {
+	if (!environment->isUsingBackend) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(backendMutex);
+
+	if (environment->isRunning) {
+		environment->isRunning = false;
+		if (--runningEnvironments == 0) {
+			Stop();
+		}
+	}
+
+	// Changes still waiting out their window would arrive after the stop
+	if (environment->debouncer.HasPending()) {
+		uv_timer_stop(environment->debounceTimer);
+		environment->debouncer.Clear();
+	}
+
+	// And so would the ones it missed while its queue was full
+	if (environment->isOverflowed) {
+		std::lock_guard<std::mutex> lock(environmentsMutex);
+		environment->overflowEvent.record.reset();
+		environment->overflowSnapshot.reset();
+		environment->isOverflowed = false;
+	}
+
+	environment->isUsingBackend = false;
+	environment->isReady = false;
+	UpdateLoopReference(environment);
+
+	if (--backendUsers > 0) {
+		return;
+	}
+
+	if (TeardownDetection()) {
+		isBackendInitialized = false;
+		isBackendReady = false;
+	}
+}
+
+napi_value RegisterReady(napi_env env, napi_callback_info info) {
+	Arguments_t args;
+	GetArguments(env, info, &args);
+	DetectionEnvironment* environment = args.environment;
+
+	if (args.argc == 0 || !IsType(env, args.argv[0], napi_function)) {
+		return ThrowTypeError(env, "First argument must be a function");
+	}
+
+	SetCallback(env, &environment->readyCallback, args.argv[0]);
+
+	// Waiting for the list only makes sense if someone is building it
+	EnsureDetection(environment);
+
+	// The backend may already be up for another environment, or have
+	// built its list while it was brought up
+	if (!environment->isReady && isBackendReady) {
+		environment->isReady = true;
+		UpdateLoopReference(environment);
+	}
+
+	if (environment->isReady) {
+		napi_value global;
+		napi_get_global(env, &global);
+		napi_call_function(env, global, args.argv[0], 0, NULL, NULL);
+	}
+
+	return NULL;
+}
+
+napi_value Find(napi_env env, napi_callback_info info) {
+	Arguments_t args;
+	GetArguments(env, info, &args);
+	DetectionEnvironment* environment = args.environment;
 
 	int vid = 0;
 	int pid = 0;
-	v8::Local<v8::Function> callback;
+	napi_value callback = NULL;
 
-	if (args.Length() == 0) {
-		return Nan::ThrowTypeError("First argument must be a function");
+	if (args.argc == 0) {
+		return ThrowTypeError(env, "First argument must be a function");
 	}
 
-	if (args.Length() == 3) {
-		if (args[0]->IsNumber() && args[1]->IsNumber()) {
-			vid = (int) args[0]->NumberValue();
-			pid = (int) args[1]->NumberValue();
+	if (args.argc == 3) {
+		if (IsType(env, args.argv[0], napi_number) && IsType(env, args.argv[1], napi_number)) {
+			vid = (int) GetNumber(env, args.argv[0]);
+			pid = (int) GetNumber(env, args.argv[1]);
 		}
 
 		// callback
-		if(!args[2]->IsFunction()) {
-			return Nan::ThrowTypeError("Third argument must be a function");
+		if(!IsType(env, args.argv[2], napi_function)) {
+			return ThrowTypeError(env, "Third argument must be a function");
 		}
 
-		callback = args[2].As<v8::Function>();
+		callback = args.argv[2];
 	}
 
-	if (args.Length() == 2) {
-		if (args[0]->IsNumber()) {
-			vid = (int) args[0]->NumberValue();
+	if (args.argc == 2) {
+		if (IsType(env, args.argv[0], napi_number)) {
+			vid = (int) GetNumber(env, args.argv[0]);
 		}
 
 		// callback
-		if(!args[1]->IsFunction()) {
-			return Nan::ThrowTypeError("Second argument must be a function");
+		if(!IsType(env, args.argv[1], napi_function)) {
+			return ThrowTypeError(env, "Second argument must be a function");
 		}
 
-		callback = args[1].As<v8::Function>();
+		callback = args.argv[1];
 	}
 
-	if (args.Length() == 1) {
+	if (args.argc == 1) {
 		// callback
-		if(!args[0]->IsFunction()) {
-			return Nan::ThrowTypeError("First argument must be a function");
+		if(!IsType(env, args.argv[0], napi_function)) {
+			return ThrowTypeError(env, "First argument must be a function");
 		}
 
-		callback = args[0].As<v8::Function>();
+		callback = args.argv[0];
+	}
+
+	if (callback == NULL) {
+		return ThrowTypeError(env, "Last argument must be a function");
 	}
 
+	EnsureDetection(environment);
+
 	ListBaton* baton = new ListBaton();
 	strcpy(baton->errorString, "");
-	baton->callback = new Nan::Callback(callback);
+	baton->callback = NULL;
+	SetCallback(env, &baton->callback, callback);
+	baton->environment = environment;
 	baton->vid = vid;
 	baton->pid = pid;
+	baton->startedAt = GetStatsTime();
+
+	napi_value name;
+	napi_create_string_utf8(env, ASYNC_RESOURCE_NAME, NAPI_AUTO_LENGTH, &name);
+	napi_create_async_work(env, NULL, name, EIO_Find, EIO_AfterFind, baton, &baton->work);
+	napi_queue_async_work(env, baton->work);
 
-	uv_work_t* req = new uv_work_t();
-	req->data = baton;
-	uv_queue_work(uv_default_loop(), req, EIO_Find, (uv_after_work_cb)EIO_AfterFind);
+	return NULL;
 }
 
-void EIO_AfterFind(uv_work_t* req) {
-	v8::Isolate* isolate = v8::Isolate::GetCurrent();
-	v8::HandleScope scope(isolate);
+void EIO_AfterFind(napi_env env, napi_status status, void* baton) {
+	ListBaton* data = static_cast<ListBaton*>(baton);
+	DetectionEnvironment* environment = data->environment;
 
-	ListBaton* data = static_cast<ListBaton*>(req->data);
+	detectionStats.find.Record(GetStatsTime() - data->startedAt);
 
-	v8::Local<v8::Value> argv[2];
+	napi_value argv[2];
 	if(data->errorString[0]) {
-		argv[0] = v8::Exception::Error(v8::String::NewFromUtf8(isolate, data->errorString));
-		argv[1] = Nan::Undefined();
+		napi_value message;
+		napi_create_string_utf8(env, data->errorString, NAPI_AUTO_LENGTH, &message);
+		napi_create_error(env, NULL, message, &argv[0]);
+		napi_get_undefined(env, &argv[1]);
 	}
 	else {
-		v8::Local<v8::Array> results = v8::Array::New(isolate);
-		int i = 0;
-		for(std::list<ListResultItem_t*>::iterator it = data->results.begin(); it != data->results.end(); it++, i++) {
-			v8::Local<v8::Object> item = v8::Object::New(isolate);
-			item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_LOCATION_ID), v8::Number::New(isolate, (*it)->locationId));
-			item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_VENDOR_ID), v8::Number::New(isolate, (*it)->vendorId));
-			item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_PRODUCT_ID), v8::Number::New(isolate, (*it)->productId));
-			item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_DEVICE_NAME), v8::String::NewFromUtf8(isolate, (*it)->deviceName.c_str()));
-			item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_MANUFACTURER), v8::String::NewFromUtf8(isolate, (*it)->manufacturer.c_str()));
-			item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_SERIAL_NUMBER), v8::String::NewFromUtf8(isolate, (*it)->serialNumber.c_str()));
-			item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_DEVICE_ADDRESS), v8::Number::New(isolate, (*it)->deviceAddress));
-			item->Set(v8::String::NewFromUtf8(isolate, OBJECT_ITEM_MOUNT_PATH),
-                        v8::String::NewFromUtf8(isolate, (*it)->mountPath.c_str()));
+		ObjectHandles_t handles;
+		GetObjectHandles(environment, &handles);
 
-			results->Set(i, item);
+		napi_create_array_with_length(env, data->results.size(), &argv[1]);
+		for(size_t i = 0; i < data->results.size(); i++) {
+			napi_set_element(env, argv[1], i, CreateDeviceObject(environment, &handles, data->results[i]));
 		}
-		argv[0] = Nan::Undefined();
-		argv[1] = results;
+		napi_get_undefined(env, &argv[0]);
 	}
 
-	data->callback->Call(2, argv);
+	napi_value callback;
+	napi_get_reference_value(env, data->callback, &callback);
+	MakeCallback(environment, callback, 2, argv);
 
-	for(std::list<ListResultItem_t*>::iterator it = data->results.begin(); it != data->results.end(); it++) {
-		delete *it;
-	}
+	// The records stay alive until the baton lets go of its snapshot
+	napi_delete_reference(env, data->callback);
+	napi_delete_async_work(env, data->work);
 	delete data;
-	delete req;
 }
 
-void StartMonitoring(const v8::FunctionCallbackInfo<v8::Value>& args) {
-	Start();
+napi_value FindSync(napi_env env, napi_callback_info info) {
+	Arguments_t args;
+	GetArguments(env, info, &args);
+	DetectionEnvironment* environment = args.environment;
+
+	int vid = 0;
+	int pid = 0;
+
+	if (args.argc >= 1 && IsType(env, args.argv[0], napi_number)) {
+		vid = (int) GetNumber(env, args.argv[0]);
+	}
+
+	if (args.argc >= 2 && IsType(env, args.argv[1], napi_number)) {
+		pid = (int) GetNumber(env, args.argv[1]);
+	}
+
+	EnsureDetection(environment);
+
+	// The snapshot is immutable, so there is nothing to lock and nothing
+	// to copy: objects are built straight from the shared records
+	std::shared_ptr<const DeviceSnapshot_t> snapshot = GetDeviceSnapshot();
+	DeviceRecordList_t records;
+	CreateFilteredRecordList(snapshot.get(), &records, vid, pid);
+
+	ObjectHandles_t handles;
+	GetObjectHandles(environment, &handles);
+
+	napi_value results;
+	napi_create_array_with_length(env, records.size(), &results);
+	for(size_t i = 0; i < records.size(); i++) {
+		napi_set_element(env, results, i, CreateDeviceObject(environment, &handles, records[i]));
+	}
+
+	return results;
 }
 
-void StopMonitoring(const v8::FunctionCallbackInfo<v8::Value>& args) {
-	Stop();
+napi_value ChangesSince(napi_env env, napi_callback_info info) {
+	Arguments_t args;
+	GetArguments(env, info, &args);
+	DetectionEnvironment* environment = args.environment;
+
+	if (args.argc == 0 || !IsType(env, args.argv[0], napi_number) || GetNumber(env, args.argv[0]) < 0) {
+		return ThrowTypeError(env, "First argument must be a generation number");
+	}
+
+	EnsureDetection(environment);
+
+	DeviceChangeSet_t changeSet;
+	GetChangesSince((unsigned long) GetNumber(env, args.argv[0]), &changeSet);
+
+	ObjectHandles_t handles;
+	GetObjectHandles(environment, &handles);
+
+	napi_value result;
+	napi_value resync;
+	napi_create_object(env, &result);
+	napi_get_boolean(env, changeSet.resyncRequired, &resync);
+	napi_set_property(env, result, handles.keys[Key_ChangeSetGeneration], CreateNumber(env, (double) changeSet.generation));
+	napi_set_property(env, result, handles.keys[Key_ChangeSetResync], resync);
+
+	napi_value changes;
+	napi_create_array_with_length(env, changeSet.changes.size(), &changes);
+	for(size_t i = 0; i < changeSet.changes.size(); i++) {
+		napi_set_element(env, changes, i, CreateChangeObject(environment, &handles, changeSet.changes[i].isAdded, changeSet.changes[i].record.get()));
+	}
+	napi_set_property(env, result, handles.keys[Key_ChangeSetChanges], changes);
+
+	if (changeSet.resyncRequired) {
+		// The full list at `generation`, so the caller can rebuild from it
+		DeviceRecordList_t records;
+		CreateFilteredRecordList(changeSet.snapshot.get(), &records, 0, 0);
+
+		napi_value devices;
+		napi_create_array_with_length(env, records.size(), &devices);
+		for(size_t i = 0; i < records.size(); i++) {
+			napi_set_element(env, devices, i, CreateDeviceObject(environment, &handles, records[i]));
+		}
+		napi_set_property(env, result, handles.keys[Key_ChangeSetDevices], devices);
+	}
+
+	return result;
 }
 
-extern "C" {
-	void init (v8::Handle<v8::Object> target) {
-		NODE_SET_METHOD(target, "find", Find);
-		NODE_SET_METHOD(target, "registerAdded", RegisterAdded);
-		NODE_SET_METHOD(target, "registerRemoved", RegisterRemoved);
-		NODE_SET_METHOD(target, "startMonitoring", StartMonitoring);
-		NODE_SET_METHOD(target, "stopMonitoring", StopMonitoring);
-		InitDetection();
+napi_value SetInterest(napi_env env, napi_callback_info info) {
+	Arguments_t args;
+	GetArguments(env, info, &args);
+	DetectionEnvironment* environment = args.environment;
+
+	if (args.argc == 0 || IsType(env, args.argv[0], napi_null) || IsType(env, args.argv[0], napi_undefined)) {
+		environment->interest.Clear();
+		return NULL;
+	}
+
+	bool isArray = false;
+	napi_is_array(env, args.argv[0], &isArray);
+	if (!isArray) {
+		return ThrowTypeError(env, "First argument must be an array of { vendorId, productId }");
+	}
+
+	napi_value list = args.argv[0];
+	uint32_t length = 0;
+	napi_get_array_length(env, list, &length);
+	std::vector<DeviceInterestEntry_t> entries;
+
+	napi_value vendorIdKey = GetObjectKey(environment, Key_VendorId);
+	napi_value productIdKey = GetObjectKey(environment, Key_ProductId);
+
+	for (uint32_t i = 0; i < length; i++) {
+		napi_value filter;
+		napi_get_element(env, list, i, &filter);
+		if (!IsType(env, filter, napi_object)) {
+			return ThrowTypeError(env, "First argument must be an array of { vendorId, productId }");
+		}
+
+		napi_value vendorId;
+		napi_value productId;
+		napi_get_property(env, filter, vendorIdKey, &vendorId);
+		napi_get_property(env, filter, productIdKey, &productId);
+		if (!IsType(env, vendorId, napi_number)) {
+			return ThrowTypeError(env, "Every entry needs a numeric vendorId");
+		}
+
+		DeviceInterestEntry_t entry;
+		entry.vendorId = (int) GetNumber(env, vendorId);
+		entry.productId = IsType(env, productId, napi_number) ? (int) GetNumber(env, productId) : 0;
+		entries.push_back(entry);
+	}
+
+	environment->interest.Set(entries);
+
+	return NULL;
+}
+
+napi_value StartMonitoring(napi_env env, napi_callback_info info) {
+	Arguments_t args;
+	GetArguments(env, info, &args);
+	DetectionEnvironment* environment = args.environment;
+
+	if (environment->isRunning) {
+		return NULL;
+	}
+
+	// Running before the backend comes up, so nothing it publishes on its
+	// way up is passed over
+	{
+		std::lock_guard<std::mutex> lock(backendMutex);
+		environment->isRunning = true;
+		if (runningEnvironments++ == 0) {
+			Start();
+		}
 	}
+
+	EnsureDetection(environment);
+	UpdateLoopReference(environment);
+
+	return NULL;
+}
+
+napi_value StopMonitoring(napi_env env, napi_callback_info info) {
+	Arguments_t args;
+	GetArguments(env, info, &args);
+
+	ReleaseDetection(args.environment);
+
+	return NULL;
+}
+
+void DeleteTimer(uv_handle_t* handle) {
+	delete (uv_timer_t*) handle;
 }
 
-NODE_MODULE(detection, init);
+// Runs once node has closed the threadsafe function, after the cleanup
+// hook below let go of it
+void FinalizeEnvironment(napi_env env, void* data, void* hint) {
+	DetectionEnvironment* environment = static_cast<DetectionEnvironment*>(data);
+
+	napi_ref* callbacks[] = { &environment->addedCallback, &environment->removedCallback, &environment->batchCallback, &environment->readyCallback };
+	for (size_t i = 0; i < sizeof(callbacks) / sizeof(callbacks[0]); i++) {
+		SetCallback(env, callbacks[i], NULL);
+	}
+	for (std::unordered_map<unsigned int, napi_ref>::iterator it = environment->subscriptionCallbacks.begin(); it != environment->subscriptionCallbacks.end(); ++it) {
+		napi_delete_reference(env, it->second);
+	}
+
+	napi_delete_reference(env, environment->objectKeys);
+	napi_delete_reference(env, environment->deviceConstructor);
+	napi_delete_reference(env, environment->stringCache);
+	napi_async_destroy(env, environment->asyncContext);
+
+	delete environment;
+}
+
+// Runs when the environment is about to go away: on worker exit, and at
+// process exit for the main thread
+void CleanupEnvironment(void* arg) {
+	DetectionEnvironment* environment = static_cast<DetectionEnvironment*>(arg);
+
+	ReleaseDetection(environment);
+
+	{
+		std::lock_guard<std::mutex> lock(environmentsMutex);
+		environments.erase(std::find(environments.begin(), environments.end(), environment));
+	}
+
+	// Neither runs anything of ours again. Their close callbacks free the
+	// timer and the environment on the pass node makes over the loop
+	// before closing it, so the loop is never run from in here.
+	uv_close((uv_handle_t*) environment->debounceTimer, DeleteTimer);
+	// Whatever is still queued is dropped
+	napi_release_threadsafe_function(environment->wakeup, napi_tsfn_abort);
+}
+
+// Called once for every environment the module is loaded into, including
+// each worker
+NAPI_MODULE_INIT() {
+	uv_loop_t* loop;
+	napi_get_uv_event_loop(env, &loop);
+
+	DetectionEnvironment* environment = new DetectionEnvironment(env, loop);
+	// Loading the module throws what went wrong
+	if (!InitObjectTemplates(environment)) {
+		delete environment;
+		return NULL;
+	}
+
+	napi_value resource;
+	napi_value name;
+	napi_create_object(env, &resource);
+	napi_create_string_utf8(env, ASYNC_RESOURCE_NAME, NAPI_AUTO_LENGTH, &name);
+	napi_async_init(env, resource, name, &environment->asyncContext);
+
+	napi_create_threadsafe_function(env, NULL, NULL, name, 0, 1, environment, FinalizeEnvironment, environment, ProcessEnvironmentEvents, &environment->wakeup);
+	napi_unref_threadsafe_function(env, environment->wakeup);
+
+	environment->debounceTimer = new uv_timer_t();
+	uv_timer_init(loop, environment->debounceTimer);
+	environment->debounceTimer->data = environment;
+	uv_unref((uv_handle_t*) environment->debounceTimer);
+
+	{
+		std::lock_guard<std::mutex> lock(environmentsMutex);
+		environments.push_back(environment);
+	}
+	napi_add_env_cleanup_hook(env, CleanupEnvironment, environment);
+
+	napi_property_descriptor methods[] = {
+		{ "find", NULL, Find, NULL, NULL, NULL, METHOD_ATTRIBUTES, environment },
+		{ "findSync", NULL, FindSync, NULL, NULL, NULL, METHOD_ATTRIBUTES, environment },
+		{ "changesSince", NULL, ChangesSince, NULL, NULL, NULL, METHOD_ATTRIBUTES, environment },
+		{ "registerAdded", NULL, RegisterAdded, NULL, NULL, NULL, METHOD_ATTRIBUTES, environment },
+		{ "registerRemoved", NULL, RegisterRemoved, NULL, NULL, NULL, METHOD_ATTRIBUTES, environment },
+		{ "registerBatch", NULL, RegisterBatch, NULL, NULL, NULL, METHOD_ATTRIBUTES, environment },
+		{ "subscribe", NULL, Subscribe, NULL, NULL, NULL, METHOD_ATTRIBUTES, environment },
+		{ "unsubscribe", NULL, Unsubscribe, NULL, NULL, NULL, METHOD_ATTRIBUTES, environment },
+		{ "registerReady", NULL, RegisterReady, NULL, NULL, NULL, METHOD_ATTRIBUTES, environment },
+		{ "setInterest", NULL, SetInterest, NULL, NULL, NULL, METHOD_ATTRIBUTES, environment },
+		{ "setDebounce", NULL, SetDebounce, NULL, NULL, NULL, METHOD_ATTRIBUTES, environment },
+		{ "getSuppressedCount", NULL, GetSuppressedCount, NULL, NULL, NULL, METHOD_ATTRIBUTES, environment },
+		{ "getStats", NULL, GetStats, NULL, NULL, NULL, METHOD_ATTRIBUTES, environment },
+		{ "startMonitoring", NULL, StartMonitoring, NULL, NULL, NULL, METHOD_ATTRIBUTES, environment },
+		{ "stopMonitoring", NULL, StopMonitoring, NULL, NULL, NULL, METHOD_ATTRIBUTES, environment }
+	};
+	NAPI_CALL(env, napi_define_properties(env, exports, sizeof(methods) / sizeof(methods[0]), methods), NULL);
+
+	return exports;
+}
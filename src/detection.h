@@ -2,41 +2,103 @@
 #ifndef _USB_DETECTION_H
 #define _USB_DETECTION_H
 
-#include <node.h>
-#include <v8.h>
+#include <node_api.h>
 #include <uv.h>
 #include <list>
 #include <string>
+#include <vector>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <nan.h>
 
 #include "deviceList.h"
+#include "eventQueue.h"
 
-void Find(const v8::FunctionCallbackInfo<v8::Value>& args);
-void EIO_Find(uv_work_t* req);
-void EIO_AfterFind(uv_work_t* req);
+// The state one Node.js environment (the main thread or a worker) keeps
+// of its own. Defined in detection.cpp.
+struct DetectionEnvironment;
+
+napi_value Find(napi_env env, napi_callback_info info);
+// Runs on the threadpool with the ListBaton, so it must not touch JS
+void EIO_Find(napi_env env, void* data);
+void EIO_AfterFind(napi_env env, napi_status status, void* data);
+napi_value FindSync(napi_env env, napi_callback_info info);
+napi_value ChangesSince(napi_env env, napi_callback_info info);
+// There is one backend per process, however many environments load the
+// module. It is initialized the first time any of them needs the device
+// list or events, rather than when the module is loaded, and doesn't
+// start monitoring by itself.
 void InitDetection();
-void StartMonitoring(const v8::FunctionCallbackInfo<v8::Value>& args);
+// Releases what InitDetection set up once no environment uses it any
+// more. Returns false if the backend can't be torn down and stays
+// initialized instead.
+bool TeardownDetection();
+napi_value StartMonitoring(napi_env env, napi_callback_info info);
+// Called when the first environment starts monitoring and when the last
+// one stops
 void Start();
-void StopMonitoring(const v8::FunctionCallbackInfo<v8::Value>& args);
+napi_value StopMonitoring(napi_env env, napi_callback_info info);
 void Stop();
 
 
 struct ListBaton {
 	public:
-		//v8::Persistent<v8::Function> callback;
-		Nan::Callback* callback;
-		std::list<ListResultItem_t*> results;
+		napi_ref callback;
+		napi_async_work work;
+		// Whose loop the results go back to
+		DetectionEnvironment* environment;
+		// Points into `snapshot`, nothing is copied
+		std::shared_ptr<const DeviceSnapshot_t> snapshot;
+		DeviceRecordList_t results;
 		char errorString[1024];
 		int vid;
 		int pid;
+		// GetStatsTime() when find was called
+		uint64_t startedAt;
+};
+
+// What a device reports about itself that costs sysfs reads to find out.
+// Only read when a device object's property is first looked at.
+struct DeviceDetails_t {
+	// Mbit/s
+	double speed;
+	int deviceClass;
+	// Sorted, without duplicates
+	std::vector<int> interfaceClasses;
 };
 
-void RegisterAdded(const v8::FunctionCallbackInfo<v8::Value>& args);
+// Backends fill in `details` for the device at `portPath`, or return
+// false if it is gone or they have no way of reading it
+bool ReadDeviceDetails(const char* portPath, DeviceDetails_t* details);
+
+// Backends report changes through these from any thread. Each change is
+// queued for every environment that is monitoring and wants the device,
+// and handed to its callbacks on that environment's own loop.
+void PublishDeviceEvent(const std::shared_ptr<const ListResultItem_t>& record, bool isAdded, uint64_t receivedAt);
 void NotifyAdded(ListResultItem_t* it);
-void RegisterRemoved(const v8::FunctionCallbackInfo<v8::Value>& args);
 void NotifyRemoved(ListResultItem_t* it);
 
+napi_value RegisterAdded(napi_env env, napi_callback_info info);
+napi_value RegisterRemoved(napi_env env, napi_callback_info info);
+// The batch callback gets every change since the last loop turn in one
+// call; null unregisters it
+napi_value RegisterBatch(napi_env env, napi_callback_info info);
+// Callbacks for one change type and vendor/product id, vendor or every
+// device. Only the matching ones are called for each change.
+napi_value Subscribe(napi_env env, napi_callback_info info);
+napi_value Unsubscribe(napi_env env, napi_callback_info info);
+// Backends call NotifyReady from any thread once the initial device list
+// is complete; a ready callback registered after that is called at once
+napi_value RegisterReady(napi_env env, napi_callback_info info);
+void NotifyReady();
+// Restricts add/remove notifications to a list of vendor/product ids
+napi_value SetInterest(napi_env env, napi_callback_info info);
+// Holds each device's changes for a window of N ms and only delivers the
+// net change, so a flapping device is reported once instead of every time
+napi_value SetDebounce(napi_env env, napi_callback_info info);
+napi_value GetSuppressedCount(napi_env env, napi_callback_info info);
+// Event counters, latency percentiles and the size of the device list.
+// Only reads counters, so it is cheap enough to call every second.
+napi_value GetStats(napi_env env, napi_callback_info info);
+
 #endif
@@ -0,0 +1,101 @@
+#include <chrono>
+
+#include "detectionStats.h"
+
+using namespace std;
+
+DetectionStats_t detectionStats;
+
+LatencyHistogram::LatencyHistogram() : count(0), sum(0), min(UINT64_MAX), max(0) {
+	for (int i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+		buckets[i] = 0;
+	}
+}
+
+int LatencyHistogram::GetBucketIndex(uint64_t value) {
+	if (value < LATENCY_LINEAR_BUCKETS) {
+		return (int) value;
+	}
+
+	int exponent = 0;
+	for (uint64_t rest = value; rest > 1; rest >>= 1) {
+		exponent++;
+	}
+
+	// The three bits after the leading one pick the sub-bucket
+	int sub = (int) ((value >> (exponent - 3)) & (LATENCY_SUB_BUCKETS - 1));
+
+	return LATENCY_LINEAR_BUCKETS + (exponent - 4) * LATENCY_SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(int index) {
+	if (index < LATENCY_LINEAR_BUCKETS) {
+		return (uint64_t) index;
+	}
+
+	int exponent = (index - LATENCY_LINEAR_BUCKETS) / LATENCY_SUB_BUCKETS + 4;
+	uint64_t sub = (index - LATENCY_LINEAR_BUCKETS) % LATENCY_SUB_BUCKETS;
+	uint64_t width = (uint64_t) 1 << (exponent - 3);
+
+	return (LATENCY_SUB_BUCKETS + sub) * width + (width - 1);
+}
+
+void LatencyHistogram::Record(uint64_t value) {
+	buckets[GetBucketIndex(value)].fetch_add(1, memory_order_relaxed);
+	count.fetch_add(1, memory_order_relaxed);
+	sum.fetch_add(value, memory_order_relaxed);
+
+	uint64_t current = min.load(memory_order_relaxed);
+	while (value < current && !min.compare_exchange_weak(current, value, memory_order_relaxed)) {
+	}
+
+	current = max.load(memory_order_relaxed);
+	while (value > current && !max.compare_exchange_weak(current, value, memory_order_relaxed)) {
+	}
+}
+
+void LatencyHistogram::Summarize(LatencySummary_t* summary) const {
+	uint64_t counts[LATENCY_BUCKET_COUNT];
+	uint64_t total = 0;
+
+	// Totals come from the buckets themselves so the percentiles always
+	// add up, whatever was recorded while we read
+	for (int i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+		counts[i] = buckets[i].load(memory_order_relaxed);
+		total += counts[i];
+	}
+
+	summary->count = total;
+	summary->max = max.load(memory_order_relaxed);
+	summary->min = total == 0 ? 0 : min.load(memory_order_relaxed);
+	summary->mean = total == 0 ? 0 : (double) sum.load(memory_order_relaxed) / (double) count.load(memory_order_relaxed);
+
+	const double quantiles[4] = { 0.5, 0.9, 0.99, 0.999 };
+	uint64_t* percentiles[4] = { &summary->p50, &summary->p90, &summary->p99, &summary->p999 };
+
+	int bucket = 0;
+	uint64_t seen = 0;
+	for (int i = 0; i < 4; i++) {
+		*percentiles[i] = 0;
+		if (total == 0) {
+			continue;
+		}
+
+		uint64_t rank = (uint64_t) (quantiles[i] * (double) total + 0.5);
+		if (rank == 0) {
+			rank = 1;
+		}
+
+		while (seen + counts[bucket] < rank && bucket < LATENCY_BUCKET_COUNT - 1) {
+			seen += counts[bucket];
+			bucket++;
+		}
+
+		uint64_t value = GetBucketUpperBound(bucket);
+		*percentiles[i] = value < summary->max ? value : summary->max;
+	}
+}
+
+uint64_t GetStatsTime() {
+	return (uint64_t) chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,90 @@
+#ifndef _DETECTION_STATS_H
+#define _DETECTION_STATS_H
+
+#include <atomic>
+#include <stdint.h>
+
+// Values below this get a bucket each, above it every power of two is
+// split into LATENCY_SUB_BUCKETS, so any value is within 12.5% of its
+// bucket's bounds
+#define LATENCY_LINEAR_BUCKETS 16
+#define LATENCY_SUB_BUCKETS 8
+#define LATENCY_BUCKET_COUNT (LATENCY_LINEAR_BUCKETS + (64 - 4) * LATENCY_SUB_BUCKETS)
+
+typedef struct {
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	double mean;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+	uint64_t p999;
+} LatencySummary_t;
+
+/*
+ * Log-linear histogram of durations, in the style of HdrHistogram.
+ *
+ * Every bucket is a relaxed atomic counter, so any thread can record
+ * without a lock and recording is a handful of instructions. A summary
+ * read while others record may or may not include their latest values.
+ */
+class LatencyHistogram {
+	public:
+		LatencyHistogram();
+
+		void Record(uint64_t value);
+
+		// Percentiles are the highest value of the bucket they fall in,
+		// capped at the largest value recorded
+		void Summarize(LatencySummary_t* summary) const;
+
+		static int GetBucketIndex(uint64_t value);
+		static uint64_t GetBucketUpperBound(int index);
+
+	private:
+		LatencyHistogram(const LatencyHistogram&);
+		LatencyHistogram& operator=(const LatencyHistogram&);
+
+		std::atomic<uint64_t> buckets[LATENCY_BUCKET_COUNT];
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> sum;
+		std::atomic<uint64_t> min;
+		std::atomic<uint64_t> max;
+};
+
+// Counters run from when the module is loaded and are never reset.
+// Durations are in microseconds.
+typedef struct {
+	// Changes the monitor thread got from the system
+	std::atomic<unsigned long> received;
+	// Not queued because nobody was interested in the device
+	std::atomic<unsigned long> filtered;
+	std::atomic<unsigned long> queued;
+	// Times a JS thread's queue was full, so the changes it missed were
+	// worked out from the device list once it caught up
+	std::atomic<unsigned long> queueOverflows;
+	// Thrown away while monitoring was stopped or stopping
+	std::atomic<unsigned long> dropped;
+	// Handed to the JS callbacks
+	std::atomic<unsigned long> delivered;
+	// Times the system dropped changes and the list had to be rescanned
+	std::atomic<unsigned long> overflows;
+
+	// From the system reporting the change to the monitor thread reading it
+	LatencyHistogram kernelToMonitor;
+	// From the monitor thread reading the change to it being queued,
+	// including the device list update
+	LatencyHistogram monitorToQueue;
+	// From being queued to being handed to the JS callbacks
+	LatencyHistogram queueToCallback;
+	// From calling find to its callback
+	LatencyHistogram find;
+} DetectionStats_t;
+
+extern DetectionStats_t detectionStats;
+
+// Microseconds on a monotonic clock, comparable across threads
+uint64_t GetStatsTime();
+
+#endif
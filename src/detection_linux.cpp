@@ -1,8 +1,14 @@
-#include <libudev.h>
+#include <algorithm>
+#include <dirent.h>
 #include <pthread.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "detection.h"
+#include "detectionStats.h"
 #include "deviceList.h"
+#include "eventSource.h"
 
 using namespace std;
 
@@ -10,14 +16,7 @@ using namespace std;
 /**********************************
  * Local defines
  **********************************/
-#define DEVICE_ACTION_ADDED "add"
-#define DEVICE_ACTION_REMOVED "remove"
-
-#define DEVICE_TYPE_DEVICE "usb_device"
-
-#define DEVICE_PROPERTY_NAME "ID_MODEL"
-#define DEVICE_PROPERTY_SERIAL "ID_SERIAL_SHORT"
-#define DEVICE_PROPERTY_VENDOR "ID_VENDOR"
+#define SYSFS_USB_DEVICES "/sys/bus/usb/devices/"
 
 
 /**********************************
@@ -29,288 +28,264 @@ using namespace std;
 /**********************************
  * Local Variables
  **********************************/
-ListResultItem_t* currentItem;
-bool isAdded;
-
-struct udev *udev;
-struct udev_enumerate *enumerate;
-struct udev_list_entry *devices, *dev_list_entry;
-struct udev_device *dev;
-
-struct udev_monitor *mon;
-int fd;
+DeviceEventSource* source = NULL;
 
 pthread_t thread;
-pthread_mutex_t notify_mutex;
-pthread_cond_t notifyNewDevice;
-thread_cond_t notifyDeviceHandled;
-
-bool newDeviceAvailable = false;
-bool deviceHandled = true;
+bool isThreadStarted = false;
 
-bool isRunning = false;
 /**********************************
  * Local Helper Functions protoypes
  **********************************/
 void BuildInitialDeviceList();
+void ReconcileDeviceList(uint64_t receivedAt);
+bool IsSameDevice(const ListResultItem_t& listed, const ListResultItem_t& present);
 
 void* ThreadFunc(void* ptr);
-void WaitForDeviceHandled();
-void SignalDeviceHandled();
-void WaitForNewDevice();
-void SignalDeviceAvailable();
+bool ReadSysfsValue(const string& path, const char* format, void* value);
 
 /**********************************
  * Public Functions
  **********************************/
-void NotifyAsync(uv_work_t* req) {
-	WaitForNewDevice();
-}
-
-void NotifyFinished(uv_work_t* req) {
-	if (isRunning) {
-		if (isAdded) {
-			NotifyAdded(currentItem);
-		} 
-		else {
-			NotifyRemoved(currentItem);
-		}
-	}
-
-	// Delete Item in case of removal
-	if(isAdded == false) {
-		delete currentItem;
-	}
-
-	SignalDeviceHandled();
-	uv_queue_work(uv_default_loop(), req, NotifyAsync, (uv_after_work_cb)NotifyFinished);
-}
-
+// The monitor thread runs from InitDetection to TeardownDetection and
+// publishes every change; each environment decides whether to deliver it
 void Start() {
-	isRunning = true;
 }
 
 void Stop() {
-	isRunning = false;
-	pthread_mutex_lock(&notify_mutex);
-	pthread_cond_signal(&notifyNewDevice);
-	pthread_mutex_unlock(&notify_mutex);
 }
 
 void InitDetection() {
-	/* Create the udev object */
-	udev = udev_new();
-	if (!udev) 
-	{
-		printf("Can't create udev\n");
+	// udev, or a replay file when one is configured
+	source = CreateDeviceEventSource();
+	if (!source->Open()) {
+		// Nothing will ever be listed, there is no point making anyone wait
+		delete source;
+		source = NULL;
+		NotifyReady();
 		return;
 	}
 
-	/* Set up a monitor to monitor devices */
-	mon = udev_monitor_new_from_netlink(udev, "udev");
-	udev_monitor_enable_receiving(mon);
+	// The initial list is built on the monitor thread too, so loading the
+	// module doesn't block the event loop on sysfs. The source is already
+	// receiving, so nothing that happens meanwhile is lost. Environments
+	// hold their loops open until the list is in.
+	isThreadStarted = pthread_create(&thread, NULL, ThreadFunc, NULL) == 0;
+}
 
-	/* Get the file descriptor (fd) for the monitor.
-	   This fd will get passed to select() */
-	fd = udev_monitor_get_fd(mon);
+bool TeardownDetection() {
+	if (source) {
+		source->Interrupt();
+		if (isThreadStarted) {
+			pthread_join(thread, NULL);
+			isThreadStarted = false;
+		}
 
-	BuildInitialDeviceList();
+		delete source;
+		source = NULL;
+	}
+	// Whatever is still queued is dropped on the next wakeup since nobody
+	// is running any more
+	ClearDeviceList();
 
-	pthread_mutex_init(&notify_mutex, NULL);
-	pthread_cond_init(&notifyNewDevice, NULL);
-	pthread_cond_init(&notifyDeviceHandled, NULL);
+	return true;
+}
 
-	uv_work_t* req = new uv_work_t();
-	uv_queue_work(uv_default_loop(), req, NotifyAsync, (uv_after_work_cb)NotifyFinished);
 
-	pthread_create(&thread, NULL, ThreadFunc, NULL);
+void EIO_Find(napi_env env, void* baton) {
+	ListBaton* data = static_cast<ListBaton*>(baton);
 
-	Start();
+	data->snapshot = GetDeviceSnapshot();
+	CreateFilteredRecordList(data->snapshot.get(), &data->results, data->vid, data->pid);
 }
 
+bool ReadDeviceDetails(const char* portPath, DeviceDetails_t* details) {
+	string devicePath = string(SYSFS_USB_DEVICES) + portPath;
+	// %x wants an unsigned int
+	unsigned int deviceClass;
+
+	if (!ReadSysfsValue(devicePath + "/speed", "%lf", &details->speed)
+		|| !ReadSysfsValue(devicePath + "/bDeviceClass", "%x", &deviceClass)) {
+		return false;
+	}
+	details->deviceClass = (int) deviceClass;
+
+	// Interfaces are the device's children, named <portPath>:<config>.<interface>
+	details->interfaceClasses.clear();
+	DIR* dir = opendir(SYSFS_USB_DEVICES);
+	if (dir == NULL) {
+		return true;
+	}
+
+	string prefix = string(portPath) + ":";
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (strncmp(entry->d_name, prefix.c_str(), prefix.length()) != 0) {
+			continue;
+		}
 
-void EIO_Find(uv_work_t* req) {
-	ListBaton* data = static_cast<ListBaton*>(req->data);
+		unsigned int interfaceClass;
+		if (ReadSysfsValue(string(SYSFS_USB_DEVICES) + entry->d_name + "/bInterfaceClass", "%x", &interfaceClass)) {
+			details->interfaceClasses.push_back((int) interfaceClass);
+		}
+	}
+	closedir(dir);
 
-	CreateFilteredList(&data->results, data->vid, data->pid);
+	sort(details->interfaceClasses.begin(), details->interfaceClasses.end());
+	details->interfaceClasses.erase(unique(details->interfaceClasses.begin(), details->interfaceClasses.end()), details->interfaceClasses.end());
+
+	return true;
 }
 
 /**********************************
  * Local Functions
  **********************************/
-void WaitForDeviceHandled() {
-	pthread_mutex_lock(&notify_mutex);
-	if(deviceHandled == false) {
-		pthread_cond_wait(&notifyDeviceHandled, &notify_mutex);
+void DeviceAdded(const DeviceSourceEvent_t& event, uint64_t receivedAt) {
+	// Already picked up by the initial enumeration
+	if(IsItemAlreadyStored((char *)event.key.c_str())) {
+		return;
 	}
-	deviceHandled = false;
-	pthread_mutex_unlock(&notify_mutex);
-}
 
-void SignalDeviceHandled() {
-	pthread_mutex_lock(&notify_mutex);
-	deviceHandled = true;
-	pthread_cond_signal(&notifyDeviceHandled);
-	pthread_mutex_unlock(&notify_mutex);
-}
+	DeviceItem_t* item = new DeviceItem_t();
+	item->deviceParams = event.device;
 
-void WaitForNewDevice() {
-	pthread_mutex_lock(&notify_mutex);
-	if(newDeviceAvailable == false){
-		pthread_cond_wait(&notifyNewDevice, &notify_mutex);
+	shared_ptr<const ListResultItem_t> record = AddItemToList((char *)event.key.c_str(), item);
+	if(!record) {
+		delete item;
+		return;
 	}
-	newDeviceAvailable = false;
-	pthread_mutex_unlock(&notify_mutex);
-}
 
-void SignalDeviceAvailable() {
-	pthread_mutex_lock(&notify_mutex);
-	newDeviceAvailable = true;
-	pthread_cond_signal(&notifyNewDevice);
-	pthread_mutex_unlock(&notify_mutex);
+	// The event shares the list's record
+	PublishDeviceEvent(record, true, receivedAt);
 }
 
+void DeviceRemoved(const DeviceSourceEvent_t& event, uint64_t receivedAt) {
+	shared_ptr<const ListResultItem_t> record;
 
- ListResultItem_t* GetProperties(struct udev_device* dev, ListResultItem_t* item) {
-	struct udev_list_entry* sysattrs;
-	struct udev_list_entry* entry;
-	sysattrs = udev_device_get_properties_list_entry(dev);
-	udev_list_entry_foreach(entry, sysattrs) {
-		const char *name, *value;
-		name = udev_list_entry_get_name(entry);
-		value = udev_list_entry_get_value(entry);
+	// The list hands back the record it held, which outlives the removal
+	// for as long as the event needs it
+	DeviceItem_t* deviceItem = GetItemFromList((char *)event.key.c_str());
+	if(deviceItem) {
+		record = RemoveItemFromList(deviceItem);
+		delete deviceItem;
+	}
 
-		if(strcmp(name, DEVICE_PROPERTY_NAME) == 0) {
-			item->deviceName = value;
-		}
-		else if(strcmp(name, DEVICE_PROPERTY_SERIAL) == 0) {
-			item->serialNumber = value;
-		}
-		else if(strcmp(name, DEVICE_PROPERTY_VENDOR) == 0) {
-			item->manufacturer = value;
-		}
+	// Never listed, so all we know is what the event said
+	if(!record) {
+		record = CreateRecord(event.device);
 	}
-	item->vendorId = strtol(udev_device_get_sysattr_value(dev,"idVendor"), NULL, 16);
-	item->productId = strtol(udev_device_get_sysattr_value(dev,"idProduct"), NULL, 16);
-	item->deviceAddress = 0;
-	item->locationId = 0;
 
-	return item;
+	PublishDeviceEvent(record, false, receivedAt);
 }
 
-void DeviceAdded(struct udev_device* dev) {
-	DeviceItem_t* item = new DeviceItem_t();
-	GetProperties(dev, &item->deviceParams);
 
-	AddItemToList((char *)udev_device_get_devnode(dev), item);
+void* ThreadFunc(void* ptr) {
+	DeviceSourceEvent_t event;
 
-	currentItem = &item->deviceParams;
-	isAdded = true;
+	BuildInitialDeviceList();
+	NotifyReady();
 
-	SignalDeviceAvailable();
-}
+	while (source->Receive(&event)) {
+		uint64_t receivedAt = GetStatsTime();
 
-void DeviceRemoved(struct udev_device* dev) {
-	ListResultItem_t* item = NULL;
+		if (event.isOverflow) {
+			detectionStats.overflows++;
+			ReconcileDeviceList(receivedAt);
+			continue;
+		}
 
-	if(IsItemAlreadyStored((char *)udev_device_get_devnode(dev))) {
-		DeviceItem_t* deviceItem = GetItemFromList((char *)udev_device_get_devnode(dev));
-		if(deviceItem) {
-			item = CopyElement(&deviceItem->deviceParams);
+		detectionStats.received++;
+		if (event.systemDelay > 0) {
+			detectionStats.kernelToMonitor.Record(event.systemDelay);
 		}
-		RemoveItemFromList(deviceItem);
-		delete deviceItem;
-	}
 
-	if(item == NULL) {
-		item = new ListResultItem_t();
-		GetProperties(dev, item);
+		if(event.isAdded) {
+			DeviceAdded(event, receivedAt);
+		}
+		else {
+			DeviceRemoved(event, receivedAt);
+		}
 	}
-	
-	currentItem = item;
-	isAdded = false;
 
-	SignalDeviceAvailable();
+	return NULL;
 }
 
 
-void* ThreadFunc(void* ptr) {
-	while (1) {
-		/* Make the call to receive the device.
-		   select() ensured that this will not block. */
-		dev = udev_monitor_receive_device(mon);
-		if (dev) {
-			if(udev_device_get_devtype(dev) && strcmp(udev_device_get_devtype(dev), DEVICE_TYPE_DEVICE) == 0) {
-				if(strcmp(udev_device_get_action(dev), DEVICE_ACTION_ADDED) == 0) {
-					WaitForDeviceHandled();
-					DeviceAdded(dev);
-				}
-				else if(strcmp(udev_device_get_action(dev), DEVICE_ACTION_REMOVED) == 0) {
-					WaitForDeviceHandled();
-					DeviceRemoved(dev);
-				}
-			}
-			udev_device_unref(dev);
+void BuildInitialDeviceList() {
+	vector<DeviceSourceEvent_t> devices;
+	source->Enumerate(&devices);
+
+	for(size_t i = 0; i < devices.size(); i++) {
+		DeviceItem_t* item = new DeviceItem_t();
+		item->deviceParams = devices[i].device;
+		item->deviceState = DeviceState_Connect;
+
+		// The same key twice, e.g. a device re-enumerated mid-scan
+		if(!AddItemToList((char *)devices[i].key.c_str(), item)) {
+			delete item;
 		}
 	}
-
-	return NULL;
 }
 
+// After the source lost changes, brings the list back in line with what is
+// actually plugged in. Only the differences go out as events, through the
+// same path as the changes that were lost would have.
+void ReconcileDeviceList(uint64_t receivedAt) {
+	vector<DeviceSourceEvent_t> devices;
+	source->Enumerate(&devices);
 
-void BuildInitialDeviceList() {
-	/* Create a list of the devices */
-	enumerate = udev_enumerate_new(udev);
-	udev_enumerate_scan_devices(enumerate);
-	devices = udev_enumerate_get_list_entry(enumerate);
-	/* For each item enumerated, print out its information.
-	   udev_list_entry_foreach is a macro which expands to
-	   a loop. The loop will be executed for each member in
-	   devices, setting dev_list_entry to a list entry
-	   which contains the device's path in /sys. */
-	udev_list_entry_foreach(dev_list_entry, devices) {
-		const char *path;
-		
-		/* Get the filename of the /sys entry for the device
-		   and create a udev_device object (dev) representing it */
-		path = udev_list_entry_get_name(dev_list_entry);
-		dev = udev_device_new_from_syspath(udev, path);
-
-		/* usb_device_get_devnode() returns the path to the device node
-		   itself in /dev. */
-		if(udev_device_get_devnode(dev) == NULL || udev_device_get_sysattr_value(dev,"idVendor") == NULL) {
+	unordered_map<string, const DeviceSourceEvent_t*> present;
+	for(size_t i = 0; i < devices.size(); i++) {
+		present[devices[i].key] = &devices[i];
+	}
+
+	// Gone, or a different device now behind the same node
+	shared_ptr<const DeviceSnapshot_t> snapshot = GetDeviceSnapshot();
+	for(int i = 0; i < DEVICE_LIST_SHARD_COUNT; i++) {
+		const DeviceShard_t* shard = snapshot->shards[i].get();
+		if (!shard) {
 			continue;
 		}
 
-		/* From here, we can call get_sysattr_value() for each file
-		   in the device's /sys entry. The strings passed into these
-		   functions (idProduct, idVendor, serial, etc.) correspond
-		   directly to the files in the /sys directory which
-		   represents the USB device. Note that USB strings are
-		   Unicode, UCS2 encoded, but the strings returned from
-		   udev_device_get_sysattr_value() are UTF-8 encoded. */
+		for(DeviceRecordMap_t::const_iterator it = shard->devices.begin(); it != shard->devices.end(); ++it) {
+			unordered_map<string, const DeviceSourceEvent_t*>::iterator found = present.find(it->first);
+			if (found != present.end() && IsSameDevice(*it->second, found->second->device)) {
+				continue;
+			}
 
-		DeviceItem_t* item = new DeviceItem_t();
-		item->deviceParams.vendorId = strtol (udev_device_get_sysattr_value(dev,"idVendor"), NULL, 16);
-		item->deviceParams.productId = strtol (udev_device_get_sysattr_value(dev,"idProduct"), NULL, 16);
-		if(udev_device_get_sysattr_value(dev,"product") != NULL) {
-			item->deviceParams.deviceName = udev_device_get_sysattr_value(dev,"product");
+			DeviceSourceEvent_t removed;
+			removed.isOverflow = false;
+			removed.isAdded = false;
+			removed.key = it->first;
+			removed.device = *it->second;
+			removed.systemDelay = 0;
+			DeviceRemoved(removed, receivedAt);
 		}
-		if(udev_device_get_sysattr_value(dev,"manufacturer") != NULL) {
-			item->deviceParams.manufacturer = udev_device_get_sysattr_value(dev,"manufacturer");
-		}
-		if(udev_device_get_sysattr_value(dev,"serial") != NULL) {
-			item->deviceParams.serialNumber = udev_device_get_sysattr_value(dev, "serial");
-		}
-		item->deviceParams.deviceAddress = 0;
-		item->deviceParams.locationId = 0;
+	}
 
-		item->deviceState = DeviceState_Connect;
+	// Devices already in the list are skipped
+	for(size_t i = 0; i < devices.size(); i++) {
+		DeviceAdded(devices[i], receivedAt);
+	}
+}
 
-		AddItemToList((char *)udev_device_get_devnode(dev), item);
+// Enumeration and events read the same sysfs attributes, so a device that
+// stayed put compares equal. The name and manufacturer don't tell devices
+// apart any better than the ids do, so they are left out.
+bool IsSameDevice(const ListResultItem_t& listed, const ListResultItem_t& present) {
+	return listed.vendorId == present.vendorId
+		&& listed.productId == present.productId
+		&& listed.serialNumber == present.serialNumber
+		&& listed.portPath == present.portPath;
+}
 
-		udev_device_unref(dev);
+bool ReadSysfsValue(const string& path, const char* format, void* value) {
+	FILE* file = fopen(path.c_str(), "r");
+	if (file == NULL) {
+		return false;
 	}
-	/* Free the enumerator object */
-	udev_enumerate_unref(enumerate);
+
+	bool isRead = fscanf(file, format, value) == 1;
+	fclose(file);
+
+	return isRead;
 }
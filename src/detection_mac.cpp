@@ -25,7 +25,6 @@
 #include <sys/param.h>
 #include <pthread.h>
 #include <unistd.h>
-#include <uv.h>
 
 #define dlog(fmt, arg...) printf("%s(%d) " fmt, __func__, __LINE__, ##arg)
 
@@ -54,24 +53,9 @@ CFRunLoopSourceRef              runLoopSource;
 
 static pthread_t                lookupThread;
 
-pthread_mutex_t                 notify_mutex;
-pthread_cond_t                  notifyNewDevice;
-pthread_cond_t                  notifyDeviceHandled;
-
-ListResultItem_t*               notify_item;
-
-bool                            newDeviceAvailable = false;
-bool                            deviceHandled      = true;
-bool                            isAdded            = false;
 bool                            isRunning          = false;
 bool                            initialDeviceImport = true;
 
-
-void WaitForDeviceHandled();
-void SignalDeviceHandled();
-void WaitForNewDevice();
-void SignalDeviceAvailable();
-
 char* cfStringRefToCString( CFStringRef cfString )
 {
   if ( !cfString ) 
@@ -161,13 +145,13 @@ void DeviceRemoved(void *refCon, io_service_t service, natural_t messageType, vo
           item = new ListResultItem_t();
         }
 
-      WaitForDeviceHandled();
-
-      notify_item = item;
-      isAdded     = false;
-
-      SignalDeviceAvailable();
+      // Queued for every environment straight from the run loop thread
+      if (isRunning)
+        {
+          NotifyRemoved(item);
+        }
 
+      delete item;
     }
 }
 
@@ -460,12 +444,9 @@ void DeviceAdded(void *refCon, io_iterator_t iterator)
 
       deviceListItem->deviceItem = deviceItem;
 
-      if (initialDeviceImport == false)
+      if (initialDeviceImport == false && isRunning)
         {
-          WaitForDeviceHandled();
-          notify_item = &deviceItem->deviceParams;
-          isAdded = true;
-          SignalDeviceAvailable();
+          NotifyAdded(&deviceItem->deviceParams);
         }
 
       // Register for an interest notification of this device being removed. Use a reference to our
@@ -489,49 +470,6 @@ void DeviceAdded(void *refCon, io_iterator_t iterator)
 }
 
 
-void WaitForDeviceHandled()
-{
-  pthread_mutex_lock(&notify_mutex);
-
-  if (deviceHandled == false)
-    {
-      pthread_cond_wait(&notifyDeviceHandled, &notify_mutex);
-    }
-
-  deviceHandled = false;
-  pthread_mutex_unlock(&notify_mutex);
-}
-
-void SignalDeviceHandled()
-{
-  pthread_mutex_lock(&notify_mutex);
-  deviceHandled = true;
-  pthread_cond_signal(&notifyDeviceHandled);
-  pthread_mutex_unlock(&notify_mutex);
-}
-
-void WaitForNewDevice()
-{
-  pthread_mutex_lock(&notify_mutex);
-
-  if (newDeviceAvailable == false)
-    {
-      pthread_cond_wait(&notifyNewDevice, &notify_mutex);
-    }
-
-  newDeviceAvailable = false;
-  pthread_mutex_unlock(&notify_mutex);
-}
-
-void SignalDeviceAvailable()
-{
-  pthread_mutex_lock(&notify_mutex);
-  newDeviceAvailable = true;
-  pthread_cond_signal(&notifyNewDevice);
-  pthread_mutex_unlock(&notify_mutex);
-}
-
-
 void *RunLoop(void * arg)
 {
 
@@ -549,40 +487,6 @@ void *RunLoop(void * arg)
   return NULL;
 }
 
-void NotifyAsync(uv_work_t* req)
-{
-  WaitForNewDevice();
-}
-
-void NotifyFinished(uv_work_t* req)
-{
-  if (isRunning)
-    {
-      if (isAdded)
-        {
-          NotifyAdded(notify_item);
-        }
-
-      else
-        {
-          NotifyRemoved(notify_item);
-        }
-    }
-
-  // Delete Item in case of removal
-  if (isAdded == false)
-    {
-      delete notify_item;
-    }
-
-  if (isRunning)
-    {
-      uv_queue_work(uv_default_loop(), req, NotifyAsync, (uv_after_work_cb)NotifyFinished);
-    }
-
-  SignalDeviceHandled();
-}
-
 void Start()
 {
   isRunning = true;
@@ -591,9 +495,6 @@ void Start()
 void Stop()
 {
   isRunning = false;
-  pthread_mutex_lock(&notify_mutex);
-  pthread_cond_signal(&notifyNewDevice);
-  pthread_mutex_unlock(&notify_mutex);
 }
 
 void InitDetection()
@@ -641,10 +542,6 @@ void InitDetection()
 
   initialDeviceImport = false;
 
-  pthread_mutex_init(&notify_mutex, NULL);
-  pthread_cond_init(&notifyNewDevice, NULL);
-  pthread_cond_init(&notifyDeviceHandled, NULL);
-
   int rc = pthread_create(&lookupThread, NULL, RunLoop, NULL);
 
   if (rc)
@@ -653,16 +550,26 @@ void InitDetection()
       exit(-1);
     }
 
-  uv_work_t* req = new uv_work_t();
-
-  uv_queue_work(uv_default_loop(), req, NotifyAsync, (uv_after_work_cb)NotifyFinished);
+  // The initial list was built synchronously above
+  NotifyReady();
+}
 
-  Start();
+bool TeardownDetection()
+{
+  // The run loop thread stays up and is reused by the next Start()
+  return false;
 }
 
-void EIO_Find(uv_work_t* req)
+void EIO_Find(napi_env env, void* baton)
 {
-  ListBaton* data = static_cast<ListBaton*>(req->data);
+  ListBaton* data = static_cast<ListBaton*>(baton);
 
-  CreateFilteredList(&data->results, data->vid, data->pid);
+  data->snapshot = GetDeviceSnapshot();
+  CreateFilteredRecordList(data->snapshot.get(), &data->results, data->vid, data->pid);
+}
+
+bool ReadDeviceDetails(const char* portPath, DeviceDetails_t* details)
+{
+  // No sysfs to read from, the IORegistry properties aren't wired up
+  return false;
 }
@@ -1,4 +1,3 @@
-#include <uv.h>
 #include <dbt.h>
 #include <iostream>
 #include <iomanip>
@@ -57,11 +56,6 @@ HWND handle;
 DWORD threadId;
 HANDLE threadHandle;
 
-HANDLE deviceChangedRegisteredEvent; 
-HANDLE deviceChangedSentEvent;
-
-ListResultItem_t* currentDevice;
-bool isAdded;
 bool isRunning = false;
 
 HINSTANCE hinstLib; 
@@ -89,9 +83,6 @@ DWORD WINAPI ListenerThread(LPVOID lpParam);
 
 void BuildInitialDeviceList();
 
-void NotifyAsync(uv_work_t* req);
-void NotifyFinished(uv_work_t* req);
-
 void ExtractDeviceInfo(HDEVINFO hDevInfo, SP_DEVINFO_DATA* pspDevInfoData, TCHAR* buf, DWORD buffSize, ListResultItem_t* resultItem);
 bool CheckValidity(ListResultItem_t* item);
 
@@ -99,32 +90,6 @@ bool CheckValidity(ListResultItem_t* item);
 /**********************************
  * Public Functions
  **********************************/
-void NotifyAsync(uv_work_t* req) {
-	WaitForSingleObject(deviceChangedRegisteredEvent, INFINITE);
-}
-
-
-void NotifyFinished(uv_work_t* req) {
-	if (isRunning) {
-		if(isAdded) {
-			NotifyAdded(currentDevice);
-		}
-		else {
-			NotifyRemoved(currentDevice);
-		}
-	}
-
-	// Delete Item in case of removal
-	if(isAdded == false) {
-		delete currentDevice;
-	}
-
-	SetEvent(deviceChangedSentEvent);
-
-	currentDevice = NULL;
-	uv_queue_work(uv_default_loop(), req, NotifyAsync, (uv_after_work_cb)NotifyFinished);
-}
-
 void LoadFunctions() {
 
 	bool success;
@@ -166,16 +131,12 @@ void Start() {
 
 void Stop() {
 	isRunning = false;
-	SetEvent(deviceChangedRegisteredEvent);
 }
 
 void InitDetection() {
 
 	LoadFunctions();
 
-	deviceChangedRegisteredEvent = CreateEvent(NULL, false /* auto-reset event */, false /* non-signalled state */, "");
-	deviceChangedSentEvent = CreateEvent(NULL, false /* auto-reset event */, true /* non-signalled state */, "");
-
 	BuildInitialDeviceList();
 
 	threadHandle = CreateThread( 
@@ -187,18 +148,27 @@ void InitDetection() {
 			&threadId
 		);
 
-	uv_work_t* req = new uv_work_t();
-	uv_queue_work(uv_default_loop(), req, NotifyAsync, (uv_after_work_cb)NotifyFinished);
+	// The initial list was built synchronously above
+	NotifyReady();
+}
 
-	Start();
+bool TeardownDetection() {
+	// The listener thread stays up and is reused by the next Start()
+	return false;
 }
 
 
-void EIO_Find(uv_work_t* req) {
+void EIO_Find(napi_env env, void* baton) {
+
+	ListBaton* data = static_cast<ListBaton*>(baton);
 
-	ListBaton* data = static_cast<ListBaton*>(req->data);
+	data->snapshot = GetDeviceSnapshot();
+	CreateFilteredRecordList(data->snapshot.get(), &data->results, data->vid, data->pid);
+}
 
-	CreateFilteredList(&data->results, data->vid, data->pid);
+bool ReadDeviceDetails(const char* portPath, DeviceDetails_t* details) {
+	// Not collected from SetupAPI yet
+	return false;
 }
 
 
@@ -342,8 +312,10 @@ void BuildInitialDeviceList() {
 		DWORD DataT;
 		DllSetupDiGetDeviceRegistryProperty(hDevInfo, pspDevInfoData, SPDRP_HARDWAREID, &DataT, (PBYTE)buf, MAX_PATH, &nSize);
 
-		AddItemToList(buf, item);
+		// ExtractDeviceInfo reuses buf, and the list needs the filled-in item
+		string key = buf;
 		ExtractDeviceInfo(hDevInfo, pspDevInfoData, buf, MAX_PATH, &item->deviceParams);
+		AddItemToList((char *) key.c_str(), item);
 	}
 	
 	if(pspDevInfoData) {
@@ -418,9 +390,6 @@ void UpdateDevice(PDEV_BROADCAST_DEVICEINTERFACE pDevInf, WPARAM wParam, DeviceS
 		}
 
 		if(szDevId == buf) {
-
-			WaitForSingleObject(deviceChangedSentEvent, INFINITE);
-
 			DWORD DataT;
 			DWORD nSize;
 			DllSetupDiGetDeviceRegistryProperty(hDevInfo, pspDevInfoData, SPDRP_HARDWAREID, &DataT, (PBYTE)buf, MAX_PATH, &nSize);
@@ -428,11 +397,15 @@ void UpdateDevice(PDEV_BROADCAST_DEVICEINTERFACE pDevInf, WPARAM wParam, DeviceS
 			if(state == DeviceState_Connect) {
 				DeviceItem_t* device = new DeviceItem_t();
 
-				AddItemToList(buf, device);
+				// ExtractDeviceInfo reuses buf, and the list needs the filled-in item
+				string key = buf;
 				ExtractDeviceInfo(hDevInfo, pspDevInfoData, buf, MAX_PATH, &device->deviceParams);
+				AddItemToList((char *) key.c_str(), device);
 
-				currentDevice = &device->deviceParams;
-				isAdded = true;
+				// Queued for every environment straight from this thread
+				if (isRunning) {
+					NotifyAdded(&device->deviceParams);
+				}
 			}
 			else {
 
@@ -451,8 +424,10 @@ void UpdateDevice(PDEV_BROADCAST_DEVICEINTERFACE pDevInf, WPARAM wParam, DeviceS
 					item = new ListResultItem_t();
 					ExtractDeviceInfo(hDevInfo, pspDevInfoData, buf, MAX_PATH, item);
 				}
-				currentDevice = item;
-				isAdded = false;
+				if (isRunning) {
+					NotifyRemoved(item);
+				}
+				delete item;
 			}
 
 			break;
@@ -466,6 +441,4 @@ void UpdateDevice(PDEV_BROADCAST_DEVICEINTERFACE pDevInf, WPARAM wParam, DeviceS
 	if(hDevInfo) {
 		DllSetupDiDestroyDeviceInfoList(hDevInfo);
 	}
-
-	SetEvent(deviceChangedRegisteredEvent);
 }
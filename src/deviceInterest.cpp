@@ -0,0 +1,32 @@
+#include "deviceInterest.h"
+#include "deviceList.h"
+
+using namespace std;
+
+void DeviceInterest::Set(const vector<DeviceInterestEntry_t>& entries) {
+	shared_ptr<DeviceInterestSet_t> next = make_shared<DeviceInterestSet_t>();
+
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (entries[i].productId == 0) {
+			next->vendors.insert(entries[i].vendorId);
+		}
+		else {
+			next->products.insert(GetProductKey(entries[i].vendorId, entries[i].productId));
+		}
+	}
+
+	atomic_store(&current, shared_ptr<const DeviceInterestSet_t>(next));
+}
+
+void DeviceInterest::Clear() {
+	atomic_store(&current, shared_ptr<const DeviceInterestSet_t>());
+}
+
+bool DeviceInterest::Matches(int vid, int pid) const {
+	shared_ptr<const DeviceInterestSet_t> interest = atomic_load(&current);
+	if (!interest) {
+		return true;
+	}
+
+	return interest->vendors.count(vid) > 0 || interest->products.count(GetProductKey(vid, pid)) > 0;
+}
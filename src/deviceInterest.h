@@ -0,0 +1,39 @@
+#ifndef _DEVICE_INTEREST_H
+#define _DEVICE_INTEREST_H
+
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+typedef struct {
+	int vendorId;
+	// 0 matches every product of the vendor
+	int productId;
+} DeviceInterestEntry_t;
+
+typedef struct {
+	std::unordered_set<int> vendors;
+	std::unordered_set<long long> products;
+} DeviceInterestSet_t;
+
+/*
+ * Limits hotplug events to the listed devices. The device list itself
+ * still tracks everything, so find() is unaffected.
+ *
+ * Each environment has its own. Set and Clear are safe to call while the
+ * monitor thread is matching; it picks the change up with the next event.
+ */
+class DeviceInterest {
+	public:
+		void Set(const std::vector<DeviceInterestEntry_t>& entries);
+		// Back to reporting every device
+		void Clear();
+		bool Matches(int vid, int pid) const;
+
+	private:
+		// Empty means no filter at all. Replaced wholesale on every change so
+		// the monitor thread only ever does one atomic load per event.
+		std::shared_ptr<const DeviceInterestSet_t> current;
+};
+
+#endif
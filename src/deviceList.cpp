@@ -1,4 +1,6 @@
+#include <deque>
 #include <map>
+#include <mutex>
 #include <string.h>
 #include <stdio.h>
 
@@ -7,18 +9,117 @@
 
 using namespace std;
 
-map<string, DeviceItem_t*> deviceMap;
+// Writers are serialised by this mutex; readers only ever touch `snapshot`
+static mutex writerMutex;
+static map<string, DeviceItem_t*> deviceMap;
+static shared_ptr<const DeviceSnapshot_t> snapshot = make_shared<DeviceSnapshot_t>();
+
+// The journal and `snapshot` only ever move together under this mutex, so
+// a journal reader always sees the snapshot its newest entry produced
+static mutex journalMutex;
+static deque<DeviceChange_t> journal;
+
+size_t GetShardIndex(const string& key) {
+	return hash<string>()(key) % DEVICE_LIST_SHARD_COUNT;
+}
+
+long long GetProductKey(int vid, int pid) {
+	return ((long long) vid << 32) | (unsigned int) pid;
+}
+
+template <typename Key>
+void RemoveFromIndex(typename DeviceIndex_t<Key>::type* index, Key key, const ListResultItem_t* item) {
+	typedef typename DeviceIndex_t<Key>::type::iterator Iterator;
+
+	pair<Iterator, Iterator> range = index->equal_range(key);
+	for (Iterator it = range.first; it != range.second; ++it) {
+		if (it->second == item) {
+			index->erase(it);
+			return;
+		}
+	}
+}
+
+template <typename Key>
+void AppendIndexMatches(const typename DeviceIndex_t<Key>::type& index, Key key, DeviceRecordList_t* records) {
+	typedef typename DeviceIndex_t<Key>::type::const_iterator Iterator;
+
+	pair<Iterator, Iterator> range = index.equal_range(key);
+	for (Iterator it = range.first; it != range.second; ++it) {
+		records->push_back(it->second);
+	}
+}
+
+
+// Must be called with writerMutex held
+void PublishShard(size_t index, const DeviceShard_t* shard, const shared_ptr<const ListResultItem_t>& record, bool isAdded) {
+	shared_ptr<DeviceSnapshot_t> next = make_shared<DeviceSnapshot_t>(*snapshot);
+	next->version++;
+	next->size += isAdded ? 1 : -1;
+	next->shards[index].reset(shard);
+
+	DeviceChange_t change;
+	change.generation = next->version;
+	change.isAdded = isAdded;
+	change.record = record;
+
+	lock_guard<mutex> lock(journalMutex);
+	if (journal.size() >= DEVICE_JOURNAL_CAPACITY) {
+		journal.pop_front();
+	}
+	journal.push_back(change);
+
+	atomic_store(&snapshot, shared_ptr<const DeviceSnapshot_t>(next));
+}
+
+shared_ptr<const ListResultItem_t> AddItemToList(char* key, DeviceItem_t * item) {
+	lock_guard<mutex> lock(writerMutex);
 
-void AddItemToList(char* key, DeviceItem_t * item) {
 	item->SetKey(key);
-	deviceMap.insert(pair<string, DeviceItem_t*>(item->GetKey(), item));
+	if(!deviceMap.insert(pair<string, DeviceItem_t*>(item->GetKey(), item)).second) {
+		return shared_ptr<const ListResultItem_t>();
+	}
+
+	size_t index = GetShardIndex(item->GetKey());
+	DeviceShard_t* shard = snapshot->shards[index] ? new DeviceShard_t(*snapshot->shards[index]) : new DeviceShard_t();
+	shared_ptr<const ListResultItem_t> record = CreateRecord(item->deviceParams);
+
+	shard->devices[item->GetKey()] = record;
+	shard->byVendor.insert(make_pair(record->vendorId, record.get()));
+	shard->byProduct.insert(make_pair(GetProductKey(record->vendorId, record->productId), record.get()));
+
+	PublishShard(index, shard, record, true);
+
+	return record;
 }
 
-void RemoveItemFromList(DeviceItem_t* item) {
-	deviceMap.erase(item->GetKey());
+shared_ptr<const ListResultItem_t> RemoveItemFromList(DeviceItem_t* item) {
+	if(item == NULL || item->GetKey() == NULL) {
+		return shared_ptr<const ListResultItem_t>();
+	}
+
+	lock_guard<mutex> lock(writerMutex);
+
+	if(deviceMap.erase(item->GetKey()) == 0) {
+		return shared_ptr<const ListResultItem_t>();
+	}
+
+	size_t index = GetShardIndex(item->GetKey());
+	DeviceShard_t* shard = new DeviceShard_t(*snapshot->shards[index]);
+	DeviceRecordMap_t::iterator it = shard->devices.find(item->GetKey());
+	shared_ptr<const ListResultItem_t> record = it->second;
+
+	RemoveFromIndex<int>(&shard->byVendor, record->vendorId, record.get());
+	RemoveFromIndex<long long>(&shard->byProduct, GetProductKey(record->vendorId, record->productId), record.get());
+	shard->devices.erase(it);
+
+	PublishShard(index, shard, record, false);
+
+	return record;
 }
 
 DeviceItem_t* GetItemFromList(char* key) {
+	lock_guard<mutex> lock(writerMutex);
 	map<string, DeviceItem_t*>::iterator it;
 
 	it = deviceMap.find(key);
@@ -31,6 +132,7 @@ DeviceItem_t* GetItemFromList(char* key) {
 }
 
 bool IsItemAlreadyStored(char* key) {
+	lock_guard<mutex> lock(writerMutex);
 	map<string, DeviceItem_t*>::iterator it;
 
 	it = deviceMap.find(key);
@@ -44,7 +146,22 @@ bool IsItemAlreadyStored(char* key) {
 	return true;
 }
 
-ListResultItem_t* CopyElement(ListResultItem_t* item) {
+void ClearDeviceList() {
+	vector<DeviceItem_t*> items;
+	{
+		lock_guard<mutex> lock(writerMutex);
+		for(map<string, DeviceItem_t*>::iterator it = deviceMap.begin(); it != deviceMap.end(); ++it) {
+			items.push_back(it->second);
+		}
+	}
+
+	for(size_t i = 0; i < items.size(); i++) {
+		RemoveItemFromList(items[i]);
+		delete items[i];
+	}
+}
+
+ListResultItem_t* CopyElement(const ListResultItem_t* item) {
     ListResultItem_t* dst = new ListResultItem_t();
     dst->locationId     =   item->locationId;
     dst->vendorId       =   item->vendorId;
@@ -52,25 +169,130 @@ ListResultItem_t* CopyElement(ListResultItem_t* item) {
     dst->deviceName     =   item->deviceName;
     dst->manufacturer   =   item->manufacturer;
     dst->serialNumber   =   item->serialNumber;
+    dst->mountPath      =   item->mountPath;
     dst->deviceAddress  =   item->deviceAddress;
+    dst->busNumber      =   item->busNumber;
+    dst->portPath       =   item->portPath;
 
     return dst;
 }
 
-void CreateFilteredList(list<ListResultItem_t*> *filteredList, int vid, int pid) {
-	map<string, DeviceItem_t*>::iterator it;
+shared_ptr<const ListResultItem_t> CreateRecord(const ListResultItem_t& item) {
+	return allocate_shared<ListResultItem_t>(PoolAllocator<ListResultItem_t>(), item);
+}
 
-	for (it = deviceMap.begin(); it != deviceMap.end(); ++it) {    
-    	DeviceItem_t* item = it->second; 
+shared_ptr<const DeviceSnapshot_t> GetDeviceSnapshot() {
+	return atomic_load(&snapshot);
+}
 
-        if (
-        	((	vid != 0 && pid != 0) && (vid == item->deviceParams.vendorId && pid == item->deviceParams.productId))
-        	|| 	((vid != 0 && pid == 0) && vid == item->deviceParams.vendorId)
-        	||	(vid == 0 && pid == 0)
-    	) {
-        	(*filteredList).push_back(CopyElement(&item->deviceParams));
-        }
+void CreateFilteredRecordList(const DeviceSnapshot_t* snapshot, DeviceRecordList_t* records, int vid, int pid) {
+	// A product id on its own never matched anything, keep it that way
+	if (vid == 0 && pid != 0) {
+		return;
+	}
+
+	if (vid == 0) {
+		records->reserve(records->size() + snapshot->size);
+	}
+
+	for (int i = 0; i < DEVICE_LIST_SHARD_COUNT; i++) {
+		const DeviceShard_t* shard = snapshot->shards[i].get();
+		if (!shard) {
+			continue;
+		}
 
-    }
+		if (vid == 0) {
+			DeviceRecordMap_t::const_iterator it;
+			for (it = shard->devices.begin(); it != shard->devices.end(); ++it) {
+				records->push_back(it->second.get());
+			}
+		}
+		else if (pid == 0) {
+			AppendIndexMatches<int>(shard->byVendor, vid, records);
+		}
+		else {
+			AppendIndexMatches<long long>(shard->byProduct, GetProductKey(vid, pid), records);
+		}
+	}
 }
 
+void CreateFilteredList(vector<ListResultItem_t> *filteredList, int vid, int pid) {
+	shared_ptr<const DeviceSnapshot_t> current = GetDeviceSnapshot();
+	DeviceRecordList_t records;
+
+	CreateFilteredRecordList(current.get(), &records, vid, pid);
+
+	filteredList->reserve(filteredList->size() + records.size());
+	for (DeviceRecordList_t::const_iterator it = records.begin(); it != records.end(); ++it) {
+		filteredList->push_back(**it);
+	}
+}
+
+void GetChangesSince(unsigned long generation, DeviceChangeSet_t* changeSet) {
+	lock_guard<mutex> lock(journalMutex);
+	shared_ptr<const DeviceSnapshot_t> current = atomic_load(&snapshot);
+
+	changeSet->generation = current->version;
+	changeSet->resyncRequired = false;
+	changeSet->changes.clear();
+	changeSet->snapshot.reset();
+
+	if (generation == current->version) {
+		return;
+	}
+
+	// Entries carry consecutive generations ending at current->version,
+	// so the one right after `generation` is found by offset
+	unsigned long oldest = current->version - journal.size() + 1;
+	if (generation > current->version || generation + 1 < oldest) {
+		changeSet->resyncRequired = true;
+		changeSet->snapshot = current;
+		return;
+	}
+
+	changeSet->changes.assign(journal.begin() + (generation + 1 - oldest), journal.end());
+}
+
+void GetChangesBetween(const DeviceSnapshot_t* from, const DeviceSnapshot_t* to, vector<DeviceChange_t>* changes) {
+	DeviceRecordMap_t empty;
+
+	for (int i = 0; i < DEVICE_LIST_SHARD_COUNT; i++) {
+		// Shards a change didn't touch are shared between snapshots
+		const DeviceShard_t* fromShard = from->shards[i].get();
+		const DeviceShard_t* toShard = to->shards[i].get();
+		if (fromShard == toShard) {
+			continue;
+		}
+
+		// Both are sorted by key, so one pass over each finds the differences
+		const DeviceRecordMap_t& before = fromShard ? fromShard->devices : empty;
+		const DeviceRecordMap_t& after = toShard ? toShard->devices : empty;
+		DeviceRecordMap_t::const_iterator old = before.begin();
+		DeviceRecordMap_t::const_iterator now = after.begin();
+
+		while (old != before.end() || now != after.end()) {
+			bool isRemoved = now == after.end() || (old != before.end() && old->first <= now->first);
+			bool isAdded = old == before.end() || (now != after.end() && now->first <= old->first);
+			bool isSame = isRemoved && isAdded && old->second == now->second;
+
+			DeviceChange_t change;
+			change.generation = to->version;
+			if (isRemoved) {
+				if (!isSame) {
+					change.isAdded = false;
+					change.record = old->second;
+					changes->push_back(change);
+				}
+				++old;
+			}
+			if (isAdded) {
+				if (!isSame) {
+					change.isAdded = true;
+					change.record = now->second;
+					changes->push_back(change);
+				}
+				++now;
+			}
+		}
+	}
+}
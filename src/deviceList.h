@@ -2,18 +2,40 @@
 #define _DEVICE_LIST_H
 
 #include <string>
-#include <list>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <string.h>
 
-typedef struct {
+#include "internedString.h"
+#include "slabPool.h"
+
+#define DEVICE_LIST_SHARD_COUNT 16
+#define DEVICE_JOURNAL_CAPACITY 1024
+
+typedef struct _ListResultItem_t {
 	public:
 		int locationId;
 		int vendorId;
 		int productId;
-		std::string deviceName;
-		std::string manufacturer;
-		std::string serialNumber;
+		InternedString deviceName;
+		InternedString manufacturer;
+		InternedString serialNumber;
 		std::string mountPath;
 		int deviceAddress;
+		// Where the device sits: the bus and the chain of hub ports
+		// leading to it, e.g. 1-1.4. Only filled in on Linux.
+		int busNumber = 0;
+		InternedString portPath;
+
+		static void* operator new(size_t size) {
+			return SlabPool<sizeof(_ListResultItem_t)>::Instance().Allocate();
+		}
+
+		static void operator delete(void* ptr) {
+			SlabPool<sizeof(_ListResultItem_t)>::Instance().Free(ptr);
+		}
 } ListResultItem_t;
 
 typedef enum  _DeviceState_t {
@@ -36,13 +58,21 @@ typedef struct _DeviceItem_t {
 		
 		~_DeviceItem_t() {
 			if(this->key != NULL) {
-				delete this->key;
+				delete[] this->key;
 			}
 		}
 
+		static void* operator new(size_t size) {
+			return SlabPool<sizeof(_DeviceItem_t)>::Instance().Allocate();
+		}
+
+		static void operator delete(void* ptr) {
+			SlabPool<sizeof(_DeviceItem_t)>::Instance().Free(ptr);
+		}
+
 		void SetKey(char* key) {
 			if(this->key != NULL) {
-				delete this->key;
+				delete[] this->key;
 			}
 			this->key = new char[strlen(key) + 1];
 			memcpy(this->key, key, strlen(key) + 1);
@@ -54,11 +84,83 @@ typedef struct _DeviceItem_t {
 } DeviceItem_t;
 
 
-void AddItemToList(char* key, DeviceItem_t * item);
-void RemoveItemFromList(DeviceItem_t* item);
+typedef std::vector<const ListResultItem_t*> DeviceRecordList_t;
+
+// Shards are copied on every change, so their nodes come from the slab pools too
+typedef std::map<std::string, std::shared_ptr<const ListResultItem_t>, std::less<std::string>,
+	PoolAllocator<std::pair<const std::string, std::shared_ptr<const ListResultItem_t> > > > DeviceRecordMap_t;
+
+template <typename Key>
+struct DeviceIndex_t {
+	typedef std::unordered_multimap<Key, const ListResultItem_t*, std::hash<Key>, std::equal_to<Key>,
+		PoolAllocator<std::pair<const Key, const ListResultItem_t*> > > type;
+};
+
+typedef struct {
+	DeviceRecordMap_t devices;
+
+	// Secondary indexes over `devices` so filtered finds only touch matches.
+	// The pointers stay valid for as long as the shard holds the records.
+	DeviceIndex_t<int>::type byVendor;
+	DeviceIndex_t<long long>::type byProduct;
+} DeviceShard_t;
+
+// Immutable view of the device list. Every change publishes a new snapshot
+// that only copies the shard it touched; readers keep the one they loaded
+// for as long as they hold it, without ever waiting on a writer.
+// `version` is the list's generation: it goes up by one per change.
+typedef struct {
+	unsigned long version;
+	size_t size;
+	std::shared_ptr<const DeviceShard_t> shards[DEVICE_LIST_SHARD_COUNT];
+} DeviceSnapshot_t;
+
+typedef struct {
+	// Generation of the snapshot this change produced
+	unsigned long generation;
+	bool isAdded;
+	std::shared_ptr<const ListResultItem_t> record;
+} DeviceChange_t;
+
+typedef struct {
+	// Generation the caller is up to date with after applying this set
+	unsigned long generation;
+	// Set when the journal no longer reaches back to the requested
+	// generation; `snapshot` then holds the full list at `generation`
+	// and `changes` is empty
+	bool resyncRequired;
+	std::vector<DeviceChange_t> changes;
+	std::shared_ptr<const DeviceSnapshot_t> snapshot;
+} DeviceChangeSet_t;
+
+
+// Writer side, called from the platform's monitor thread. The list copies
+// `item->deviceParams` when it is added, so it must already be filled in.
+// Both return the record the list held for the device (empty if the key
+// was already, or never, in the list), so events can share it.
+std::shared_ptr<const ListResultItem_t> AddItemToList(char* key, DeviceItem_t * item);
+std::shared_ptr<const ListResultItem_t> RemoveItemFromList(DeviceItem_t* item);
 bool IsItemAlreadyStored(char* identifier);
 DeviceItem_t* GetItemFromList(char* key);
-ListResultItem_t* CopyElement(ListResultItem_t* item);
-void CreateFilteredList(std::list<ListResultItem_t*>* filteredList, int vid, int pid);
+// Removes and frees every device, one journaled removal at a time
+void ClearDeviceList();
+ListResultItem_t* CopyElement(const ListResultItem_t* item);
+std::shared_ptr<const ListResultItem_t> CreateRecord(const ListResultItem_t& item);
+
+// Reader side, safe to call from any thread
+std::shared_ptr<const DeviceSnapshot_t> GetDeviceSnapshot();
+// The records stay valid for as long as the caller holds `snapshot`
+void CreateFilteredRecordList(const DeviceSnapshot_t* snapshot, DeviceRecordList_t* records, int vid, int pid);
+// Results are copied by value into one contiguous block owned by the caller
+void CreateFilteredList(std::vector<ListResultItem_t>* filteredList, int vid, int pid);
+// Changes made after `generation`, oldest first, from a journal of the
+// last DEVICE_JOURNAL_CAPACITY changes
+void GetChangesSince(unsigned long generation, DeviceChangeSet_t* changeSet);
+// The removals and additions that turn `from` into `to`, however far apart
+// they are. A device replaced under the same key is removed, then added.
+void GetChangesBetween(const DeviceSnapshot_t* from, const DeviceSnapshot_t* to, std::vector<DeviceChange_t>* changes);
+
+// Packs a vendor and product id into one key for hashing
+long long GetProductKey(int vid, int pid);
 
 #endif
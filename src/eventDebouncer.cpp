@@ -0,0 +1,93 @@
+#include "eventDebouncer.h"
+
+using namespace std;
+
+DebounceKey_t GetDebounceKey(const shared_ptr<const ListResultItem_t>& item) {
+	DebounceKey_t key;
+	key.vendorId = item->vendorId;
+	key.productId = item->productId;
+	key.serial = item->serialNumber.Id();
+	key.locationId = item->locationId;
+	key.portPath = item->portPath.Id();
+
+	return key;
+}
+
+size_t EventDebouncer::KeyHash::operator()(const DebounceKey_t& key) const {
+	size_t seed = hash<long long>()(GetProductKey(key.vendorId, key.productId));
+	seed = seed * 31 + hash<unsigned int>()(key.serial);
+	seed = seed * 31 + hash<int>()(key.locationId);
+	return seed * 31 + hash<unsigned int>()(key.portPath);
+}
+
+bool EventDebouncer::KeyEqual::operator()(const DebounceKey_t& a, const DebounceKey_t& b) const {
+	return a.vendorId == b.vendorId && a.productId == b.productId && a.serial == b.serial && a.locationId == b.locationId && a.portPath == b.portPath;
+}
+
+void EventDebouncer::SetWindow(uint64_t window) {
+	this->window = window;
+}
+
+uint64_t EventDebouncer::GetWindow() const {
+	return window;
+}
+
+void EventDebouncer::Add(const DeviceEvent_t& event, uint64_t now) {
+	DebounceKey_t key = GetDebounceKey(event.record);
+
+	PendingMap_t::iterator found = pending.find(key);
+	if (found != pending.end()) {
+		found->second.last = event;
+		found->second.count++;
+		return;
+	}
+
+	PendingWindow_t entry;
+	entry.firstIsAdded = event.isAdded;
+	entry.last = event;
+	entry.count = 1;
+	entry.deadline = now + window;
+
+	pending[key] = entry;
+	order.push_back(key);
+}
+
+void EventDebouncer::Flush(uint64_t now, vector<DeviceEvent_t>* ready) {
+	while (!order.empty()) {
+		PendingMap_t::iterator found = pending.find(order.front());
+		if (found->second.deadline > now) {
+			break;
+		}
+
+		PendingWindow_t& entry = found->second;
+		// Events for one device alternate, so the state only moved if the
+		// window ended on the same kind of change it started with
+		if (entry.last.isAdded == entry.firstIsAdded) {
+			ready->push_back(entry.last);
+			suppressed += entry.count - 1;
+		}
+		else {
+			suppressed += entry.count;
+		}
+
+		pending.erase(found);
+		order.pop_front();
+	}
+}
+
+uint64_t EventDebouncer::NextDeadline() const {
+	return pending.find(order.front())->second.deadline;
+}
+
+bool EventDebouncer::HasPending() const {
+	return !order.empty();
+}
+
+void EventDebouncer::Clear() {
+	pending.clear();
+	order.clear();
+}
+
+unsigned long EventDebouncer::SuppressedCount() const {
+	return suppressed;
+}
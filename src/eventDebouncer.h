@@ -0,0 +1,91 @@
+#ifndef _EVENT_DEBOUNCER_H
+#define _EVENT_DEBOUNCER_H
+
+#include <deque>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "eventQueue.h"
+
+typedef struct {
+	int vendorId;
+	int productId;
+	// Interned id of the serial number
+	unsigned int serial;
+	// Where it is plugged in, so identical devices without a serial number
+	// stay apart. Both survive unplugging and plugging back into the same
+	// port, unlike the device address.
+	int locationId;
+	// Interned id of the port path
+	unsigned int portPath;
+} DebounceKey_t;
+
+/*
+ * Collapses a device flapping in and out into its net change.
+ *
+ * The first event for a device opens a window of `window` ms. Every event
+ * for the same device (vendor, product, serial number and port) until the
+ * window closes joins it, and when it closes the device's state is compared with
+ * what it was before the window: add, remove, add comes out as one add
+ * and add, remove as nothing at all. Devices with the same serial number
+ * (or none) are told apart by the port they are in; Windows doesn't
+ * report one, so there they are only told apart by vendor and product.
+ *
+ * Times are in ms from any fixed origin. Only the JS thread uses it.
+ */
+class EventDebouncer {
+	public:
+		EventDebouncer() : window(0), suppressed(0) {}
+
+		// 0 turns debouncing off. Windows that are already open keep the
+		// deadline they were opened with.
+		void SetWindow(uint64_t window);
+		uint64_t GetWindow() const;
+
+		void Add(const DeviceEvent_t& event, uint64_t now);
+
+		// Appends the net change of every window closed by `now` to
+		// `ready`, in the order the windows were opened
+		void Flush(uint64_t now, std::vector<DeviceEvent_t>* ready);
+
+		// When the oldest open window closes; only meaningful if HasPending()
+		uint64_t NextDeadline() const;
+		bool HasPending() const;
+
+		// Drops every open window without counting anything as suppressed
+		void Clear();
+
+		// Events that were collapsed away instead of delivered
+		unsigned long SuppressedCount() const;
+
+	private:
+		EventDebouncer(const EventDebouncer&);
+		EventDebouncer& operator=(const EventDebouncer&);
+
+		struct KeyHash {
+			size_t operator()(const DebounceKey_t& key) const;
+		};
+
+		struct KeyEqual {
+			bool operator()(const DebounceKey_t& a, const DebounceKey_t& b) const;
+		};
+
+		typedef struct {
+			bool firstIsAdded;
+			DeviceEvent_t last;
+			unsigned long count;
+			uint64_t deadline;
+		} PendingWindow_t;
+
+		typedef std::unordered_map<DebounceKey_t, PendingWindow_t, KeyHash, KeyEqual> PendingMap_t;
+
+		PendingMap_t pending;
+		// Windows all last as long, so opening order is closing order
+		std::deque<DebounceKey_t> order;
+
+		uint64_t window;
+		unsigned long suppressed;
+};
+
+#endif
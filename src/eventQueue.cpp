@@ -0,0 +1,54 @@
+#include <utility>
+
+#include "eventQueue.h"
+
+
+DeviceEventQueue::DeviceEventQueue(size_t capacity) : head(0), tail(0) {
+	size_t size = 1;
+	while(size < capacity) {
+		size <<= 1;
+	}
+
+	slots = new DeviceEvent_t[size];
+	mask = size - 1;
+}
+
+DeviceEventQueue::~DeviceEventQueue() {
+	delete[] slots;
+}
+
+bool DeviceEventQueue::Push(const DeviceEvent_t& event) {
+	size_t currentTail = tail.load(std::memory_order_relaxed);
+
+	if(currentTail - head.load(std::memory_order_acquire) > mask) {
+		return false;
+	}
+
+	slots[currentTail & mask] = event;
+	tail.store(currentTail + 1, std::memory_order_release);
+
+	return true;
+}
+
+size_t DeviceEventQueue::Pop(DeviceEvent_t* out, size_t max) {
+	size_t currentHead = head.load(std::memory_order_relaxed);
+	size_t available = tail.load(std::memory_order_acquire) - currentHead;
+	size_t count = available < max ? available : max;
+
+	for(size_t i = 0; i < count; i++) {
+		// Moved out so the slot doesn't keep the record alive
+		out[i] = std::move(slots[(currentHead + i) & mask]);
+	}
+
+	head.store(currentHead + count, std::memory_order_release);
+
+	return count;
+}
+
+bool DeviceEventQueue::IsEmpty() const {
+	return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+}
+
+size_t DeviceEventQueue::Capacity() const {
+	return mask + 1;
+}
@@ -0,0 +1,59 @@
+#ifndef _EVENT_QUEUE_H
+#define _EVENT_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+
+#include "deviceList.h"
+
+#define EVENT_QUEUE_DEFAULT_CAPACITY 16384
+
+typedef struct {
+	// The same immutable record the device list holds, so handing a
+	// change from the monitor to JS never copies the device
+	std::shared_ptr<const ListResultItem_t> record;
+	bool isAdded;
+	// GetStatsTime() when the event was queued, for the latency stats
+	uint64_t queuedAt;
+} DeviceEvent_t;
+
+/*
+ * Bounded single-producer/single-consumer ring of device events.
+ *
+ * Each environment has one. The backend is the only producer (it
+ * publishes to every environment under one lock) and that environment's
+ * JS thread the only consumer, so neither side takes a lock on the ring
+ * itself: each owns one index and only reads the other's.
+ */
+class DeviceEventQueue {
+	public:
+		// The capacity is rounded up to the next power of two
+		explicit DeviceEventQueue(size_t capacity = EVENT_QUEUE_DEFAULT_CAPACITY);
+		~DeviceEventQueue();
+
+		// Producer side. Returns false when the ring is full.
+		bool Push(const DeviceEvent_t& event);
+
+		// Consumer side. Moves up to `max` events into `out` and returns how many.
+		size_t Pop(DeviceEvent_t* out, size_t max);
+
+		bool IsEmpty() const;
+		size_t Capacity() const;
+
+	private:
+		DeviceEventQueue(const DeviceEventQueue&);
+		DeviceEventQueue& operator=(const DeviceEventQueue&);
+
+		DeviceEvent_t* slots;
+		size_t mask;
+
+		// Kept a cache line apart so producer and consumer don't false
+		// share. Padded rather than aligned, so a queue can be a member of
+		// something allocated with plain new before C++17.
+		std::atomic<size_t> head;
+		char padding[64];
+		std::atomic<size_t> tail;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef _EVENT_SOURCE_H
+#define _EVENT_SOURCE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "deviceList.h"
+
+typedef struct {
+	// Set instead of a change when the source lost some. Nothing else is
+	// filled in; the list has to be checked against Enumerate instead.
+	bool isOverflow;
+	bool isAdded;
+	// Identifies the device in the list, e.g. its devnode
+	std::string key;
+	ListResultItem_t device;
+	// Microseconds the change spent on the system's side before the
+	// source read it, or 0 when the source can't tell
+	uint64_t systemDelay;
+} DeviceSourceEvent_t;
+
+/*
+ * Where the monitor gets its devices from.
+ *
+ * Open runs once on the JS thread at load time and must start receiving
+ * right away. Enumerate and then Receive, in a loop, are called from the
+ * monitor thread, so a source only ever has one caller at a time.
+ */
+class DeviceEventSource {
+	public:
+		virtual ~DeviceEventSource() {}
+
+		virtual bool Open() = 0;
+
+		// Devices present right now, reported as additions. Called once
+		// before the first Receive and again after every overflow.
+		virtual void Enumerate(std::vector<DeviceSourceEvent_t>* devices) = 0;
+
+		// Blocks until the next add, remove or overflow. Returns false
+		// once the source has nothing more to report.
+		virtual bool Receive(DeviceSourceEvent_t* event) = 0;
+
+		// Safe to call from any thread. Makes a Receive that is blocked,
+		// and every later one, return false.
+		virtual void Interrupt() = 0;
+};
+
+// Provided by whichever backend the addon is built with
+DeviceEventSource* CreateDeviceEventSource();
+
+#endif
@@ -0,0 +1,60 @@
+#include <mutex>
+#include <unordered_map>
+#include <string.h>
+
+#include "internedString.h"
+
+
+using namespace std;
+
+static mutex tableMutex;
+static unordered_map<string, weak_ptr<const InternedStringEntry_t> > table;
+static unsigned int nextId = 1;
+
+// Table size at which we next drop entries whose strings are gone
+static size_t sweepThreshold = 64;
+
+static void SweepTable() {
+	unordered_map<string, weak_ptr<const InternedStringEntry_t> >::iterator it = table.begin();
+	while(it != table.end()) {
+		if(it->second.expired()) {
+			it = table.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	sweepThreshold = table.size() * 2 > 64 ? table.size() * 2 : 64;
+}
+
+shared_ptr<const InternedStringEntry_t> InternedString::Intern(const char* value) {
+	if(value == NULL || value[0] == '\0') {
+		return shared_ptr<const InternedStringEntry_t>();
+	}
+
+	lock_guard<mutex> lock(tableMutex);
+
+	weak_ptr<const InternedStringEntry_t>& slot = table[value];
+	shared_ptr<const InternedStringEntry_t> entry = slot.lock();
+	if(entry) {
+		return entry;
+	}
+
+	shared_ptr<InternedStringEntry_t> created = make_shared<InternedStringEntry_t>();
+	created->id = nextId++;
+	created->value = value;
+	slot = created;
+
+	if(table.size() >= sweepThreshold) {
+		SweepTable();
+	}
+
+	return created;
+}
+
+size_t InternedString::TableSize() {
+	lock_guard<mutex> lock(tableMutex);
+
+	return table.size();
+}
@@ -0,0 +1,69 @@
+#ifndef _INTERNED_STRING_H
+#define _INTERNED_STRING_H
+
+#include <memory>
+#include <string>
+
+typedef struct {
+	// Unique for the lifetime of the process, never reused
+	unsigned int id;
+	std::string value;
+} InternedStringEntry_t;
+
+/*
+ * Immutable handle to a string stored once in a process-wide table.
+ *
+ * Devices in the same rack tend to report the same vendor and model
+ * strings, so they all share one copy, and copying a handle is only a
+ * refcount bump. The empty string is id 0 and needs no table entry.
+ */
+class InternedString {
+	public:
+		InternedString() {}
+		InternedString(const char* value) : entry(Intern(value)) {}
+		InternedString(const std::string& value) : entry(Intern(value.c_str())) {}
+
+		InternedString& operator=(const char* value) {
+			entry = Intern(value);
+			return *this;
+		}
+
+		InternedString& operator=(const std::string& value) {
+			entry = Intern(value.c_str());
+			return *this;
+		}
+
+		const char* c_str() const {
+			return entry ? entry->value.c_str() : "";
+		}
+
+		size_t length() const {
+			return entry ? entry->value.length() : 0;
+		}
+
+		bool empty() const {
+			return !entry;
+		}
+
+		unsigned int Id() const {
+			return entry ? entry->id : 0;
+		}
+
+		bool operator==(const InternedString& other) const {
+			return entry == other.entry;
+		}
+
+		bool operator!=(const InternedString& other) const {
+			return entry != other.entry;
+		}
+
+		// Number of distinct strings currently held in the table
+		static size_t TableSize();
+
+	private:
+		static std::shared_ptr<const InternedStringEntry_t> Intern(const char* value);
+
+		std::shared_ptr<const InternedStringEntry_t> entry;
+};
+
+#endif
@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "registrySnapshot.h"
+
+using namespace std;
+
+#define SNAPSHOT_MAGIC 0x55534253
+#define SNAPSHOT_VERSION 1
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t recordSize;
+	uint32_t count;
+	uint64_t stringsLength;
+} SnapshotHeader_t;
+
+// Strings are offsets into the table after the records. Offset 0 is the
+// empty string.
+typedef struct _SnapshotRecord_t {
+	uint64_t inode;
+	int64_t changedAt;
+	int32_t locationId;
+	int32_t vendorId;
+	int32_t productId;
+	int32_t deviceAddress;
+	int32_t busNumber;
+	uint32_t syspath;
+	uint32_t key;
+	uint32_t deviceName;
+	uint32_t manufacturer;
+	uint32_t serialNumber;
+	uint32_t portPath;
+} SnapshotRecord_t;
+
+
+bool GetSysfsStamp(const char* syspath, SysfsStamp_t* stamp) {
+	struct stat info;
+	if (stat(syspath, &info) != 0) {
+		return false;
+	}
+
+	stamp->inode = info.st_ino;
+	stamp->changedAt = (int64_t) info.st_ctim.tv_sec * 1000000000 + info.st_ctim.tv_nsec;
+
+	return true;
+}
+
+RegistrySnapshot::RegistrySnapshot() : data(NULL), length(0), records(NULL), count(0), strings(NULL), stringsLength(0) {
+}
+
+RegistrySnapshot::~RegistrySnapshot() {
+	if (data != NULL) {
+		munmap(data, length);
+	}
+}
+
+bool RegistrySnapshot::Open(const string& path) {
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(SnapshotHeader_t)) {
+		close(fd);
+		return false;
+	}
+
+	length = info.st_size;
+	data = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		data = NULL;
+		return false;
+	}
+
+	const SnapshotHeader_t* header = (const SnapshotHeader_t*) data;
+	size_t recordsLength = (size_t) header->count * sizeof(SnapshotRecord_t);
+	bool isValid = header->magic == SNAPSHOT_MAGIC && header->version == SNAPSHOT_VERSION
+		&& header->recordSize == sizeof(SnapshotRecord_t)
+		&& header->stringsLength > 0
+		&& sizeof(SnapshotHeader_t) + recordsLength + header->stringsLength == length;
+
+	// Every string the records point at has to end inside the table
+	const char* table = (const char*) data + sizeof(SnapshotHeader_t) + recordsLength;
+	if (!isValid || table[header->stringsLength - 1] != '\0' || table[0] != '\0') {
+		munmap(data, length);
+		data = NULL;
+		return false;
+	}
+
+	records = (const SnapshotRecord_t*) ((const char*) data + sizeof(SnapshotHeader_t));
+	count = header->count;
+	strings = table;
+	stringsLength = header->stringsLength;
+
+	return true;
+}
+
+size_t RegistrySnapshot::Size() const {
+	return count;
+}
+
+const char* RegistrySnapshot::GetString(uint32_t offset) const {
+	return offset < stringsLength ? strings + offset : "";
+}
+
+bool RegistrySnapshot::Find(const string& syspath, const SysfsStamp_t& stamp, DeviceSourceEvent_t* device) const {
+	size_t low = 0;
+	size_t high = count;
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		int order = strcmp(GetString(records[middle].syspath), syspath.c_str());
+		if (order < 0) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+
+	if (low == count || syspath != GetString(records[low].syspath)) {
+		return false;
+	}
+
+	const SnapshotRecord_t& record = records[low];
+	if (record.inode != stamp.inode || record.changedAt != stamp.changedAt) {
+		return false;
+	}
+
+	device->isOverflow = false;
+	device->isAdded = true;
+	device->key = GetString(record.key);
+	device->device = ListResultItem_t();
+	device->device.locationId = record.locationId;
+	device->device.vendorId = record.vendorId;
+	device->device.productId = record.productId;
+	device->device.deviceAddress = record.deviceAddress;
+	device->device.busNumber = record.busNumber;
+	device->device.deviceName = GetString(record.deviceName);
+	device->device.manufacturer = GetString(record.manufacturer);
+	device->device.serialNumber = GetString(record.serialNumber);
+	device->device.portPath = GetString(record.portPath);
+	device->systemDelay = 0;
+
+	return true;
+}
+
+uint32_t AppendString(string* table, const char* value) {
+	if (value == NULL || value[0] == '\0') {
+		return 0;
+	}
+
+	uint32_t offset = table->size();
+	table->append(value);
+	table->push_back('\0');
+
+	return offset;
+}
+
+bool CompareSyspaths(const SnapshotEntry_t* a, const SnapshotEntry_t* b) {
+	return strcmp(a->syspath.c_str(), b->syspath.c_str()) < 0;
+}
+
+bool RegistrySnapshot::Write(const string& path, const vector<SnapshotEntry_t>& entries) {
+	vector<const SnapshotEntry_t*> sorted;
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (!entries[i].device.key.empty()) {
+			sorted.push_back(&entries[i]);
+		}
+	}
+	sort(sorted.begin(), sorted.end(), CompareSyspaths);
+
+	string table(1, '\0');
+	vector<SnapshotRecord_t> records(sorted.size());
+	for (size_t i = 0; i < sorted.size(); i++) {
+		const ListResultItem_t& device = sorted[i]->device.device;
+		SnapshotRecord_t& record = records[i];
+
+		record.inode = sorted[i]->stamp.inode;
+		record.changedAt = sorted[i]->stamp.changedAt;
+		record.locationId = device.locationId;
+		record.vendorId = device.vendorId;
+		record.productId = device.productId;
+		record.deviceAddress = device.deviceAddress;
+		record.busNumber = device.busNumber;
+		record.syspath = AppendString(&table, sorted[i]->syspath.c_str());
+		record.key = AppendString(&table, sorted[i]->device.key.c_str());
+		record.deviceName = AppendString(&table, device.deviceName.c_str());
+		record.manufacturer = AppendString(&table, device.manufacturer.c_str());
+		record.serialNumber = AppendString(&table, device.serialNumber.c_str());
+		record.portPath = AppendString(&table, device.portPath.c_str());
+	}
+
+	SnapshotHeader_t header;
+	header.magic = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	header.recordSize = sizeof(SnapshotRecord_t);
+	header.count = records.size();
+	header.stringsLength = table.size();
+
+	// Written next to the real file and renamed over it, so concurrent
+	// writers and readers only ever see a whole file
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%d", (int) getpid());
+	string temporary = path + suffix;
+
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (file == NULL) {
+		return false;
+	}
+
+	bool isWritten = fwrite(&header, sizeof(header), 1, file) == 1
+		&& (records.empty() || fwrite(&records[0], sizeof(SnapshotRecord_t), records.size(), file) == records.size())
+		&& fwrite(table.data(), 1, table.size(), file) == table.size();
+	isWritten = fclose(file) == 0 && isWritten;
+
+	if (!isWritten || rename(temporary.c_str(), path.c_str()) != 0) {
+		unlink(temporary.c_str());
+		return false;
+	}
+
+	return true;
+}
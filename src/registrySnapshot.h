@@ -0,0 +1,67 @@
+#ifndef _REGISTRY_SNAPSHOT_H
+#define _REGISTRY_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "eventSource.h"
+
+#define SNAPSHOT_FILE_ENV "USB_DETECTION_SNAPSHOT"
+
+// Identifies one appearance of a device's sysfs directory. The kernel
+// creates a new directory, with a new inode and creation time, every time
+// a device is plugged in, so an unchanged stamp means unchanged attributes.
+typedef struct {
+	uint64_t inode;
+	int64_t changedAt;
+} SysfsStamp_t;
+
+bool GetSysfsStamp(const char* syspath, SysfsStamp_t* stamp);
+
+typedef struct {
+	std::string syspath;
+	SysfsStamp_t stamp;
+	// `key` is left empty for an entry that isn't a device we report
+	DeviceSourceEvent_t device;
+} SnapshotEntry_t;
+
+/*
+ * A file of every device an enumeration found, so the next process to
+ * start can map it and only read the devices whose stamp has changed
+ * instead of every attribute of every device.
+ *
+ * Records are fixed size and sorted by syspath, so a lookup is a binary
+ * search straight over the mapping. Write replaces the file with a rename,
+ * so readers either map the old file or the new one, never half of one.
+ * Anything that doesn't look like a file this version wrote is ignored.
+ */
+class RegistrySnapshot {
+	public:
+		RegistrySnapshot();
+		~RegistrySnapshot();
+
+		// Returns false if there is no usable snapshot at `path`
+		bool Open(const std::string& path);
+		size_t Size() const;
+
+		// Fills in `device` from the snapshot if it holds `syspath` with
+		// the same stamp
+		bool Find(const std::string& syspath, const SysfsStamp_t& stamp, DeviceSourceEvent_t* device) const;
+
+		// Entries without a key are left out
+		static bool Write(const std::string& path, const std::vector<SnapshotEntry_t>& entries);
+
+	private:
+		const char* GetString(uint32_t offset) const;
+
+		void* data;
+		size_t length;
+		const struct _SnapshotRecord_t* records;
+		size_t count;
+		const char* strings;
+		size_t stringsLength;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "replayEventSource.h"
+
+#define REPLAY_ACTION_ADDED "add"
+#define REPLAY_ACTION_REMOVED "remove"
+#define REPLAY_ACTION_OVERFLOW "overflow"
+
+using namespace std;
+
+ReplayEventSource::ReplayEventSource(const string& path, double rate)
+	: path(path), rate(rate), delivered(0), interrupted(false) {
+}
+
+ReplayEventSource* ReplayEventSource::FromEnvironment() {
+	const char* path = getenv(REPLAY_FILE_ENV);
+	if (path == NULL || *path == '\0') {
+		return NULL;
+	}
+
+	const char* rate = getenv(REPLAY_RATE_ENV);
+	return new ReplayEventSource(path, rate ? atof(rate) : 0);
+}
+
+bool ReplayEventSource::Open() {
+	file.open(path.c_str());
+	if (!file.is_open()) {
+		printf("Can't open replay file %s\n", path.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void ReplayEventSource::Enumerate(vector<DeviceSourceEvent_t>* devices) {
+	// Empty until records have been read, so at startup everything in the
+	// file is played back as hotplug events
+	for (map<string, DeviceSourceEvent_t>::const_iterator it = present.begin(); it != present.end(); ++it) {
+		devices->push_back(it->second);
+	}
+}
+
+bool ReplayEventSource::Receive(DeviceSourceEvent_t* event) {
+	string line;
+
+	while (getline(file, line)) {
+		unsigned long lost;
+
+		if (ParseOverflow(line, &lost)) {
+			DeviceSourceEvent_t record;
+			while (lost > 0 && getline(file, line)) {
+				if (ParseRecord(line, &record)) {
+					TrackRecord(record);
+					lost--;
+				}
+			}
+
+			*event = DeviceSourceEvent_t();
+			event->isOverflow = true;
+		}
+		else if (ParseRecord(line, event)) {
+			TrackRecord(*event);
+		}
+		else {
+			continue;
+		}
+
+		unique_lock<mutex> lock(interruptMutex);
+		if (delivered == 0) {
+			start = chrono::steady_clock::now();
+		}
+		else if (rate > 0) {
+			chrono::steady_clock::time_point due = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(delivered / rate));
+			interruptCondition.wait_until(lock, due, [this]() { return interrupted; });
+		}
+
+		if (interrupted) {
+			return false;
+		}
+		delivered++;
+
+		return true;
+	}
+
+	return false;
+}
+
+void ReplayEventSource::Interrupt() {
+	lock_guard<mutex> lock(interruptMutex);
+	interrupted = true;
+	interruptCondition.notify_all();
+}
+
+void ReplayEventSource::TrackRecord(const DeviceSourceEvent_t& event) {
+	if (event.isAdded) {
+		present[event.key] = event;
+	}
+	else {
+		present.erase(event.key);
+	}
+}
+
+bool ReplayEventSource::ParseOverflow(const string& line, unsigned long* lost) {
+	istringstream fields(line);
+	string action;
+
+	return (fields >> action) && action == REPLAY_ACTION_OVERFLOW && (fields >> *lost);
+}
+
+bool ReplayEventSource::ParseRecord(const string& line, DeviceSourceEvent_t* event) {
+	istringstream fields(line);
+	string action;
+	string vendorId;
+	string productId;
+	string name;
+	string manufacturer;
+	string serialNumber;
+
+	if (!(fields >> action) || action[0] == '#') {
+		return false;
+	}
+
+	if (action == REPLAY_ACTION_ADDED) {
+		event->isAdded = true;
+	}
+	else if (action == REPLAY_ACTION_REMOVED) {
+		event->isAdded = false;
+	}
+	else {
+		return false;
+	}
+
+	if (!(fields >> event->key >> vendorId >> productId)) {
+		return false;
+	}
+	fields >> name >> manufacturer >> serialNumber;
+
+	event->device = ListResultItem_t();
+	event->device.vendorId = strtol(vendorId.c_str(), NULL, 16);
+	event->device.productId = strtol(productId.c_str(), NULL, 16);
+	event->device.deviceName = name;
+	event->device.manufacturer = manufacturer;
+	event->device.serialNumber = serialNumber;
+	// Replayed devices have no sysfs entry, so only the devnode's bus and
+	// address are filled in
+	sscanf(event->key.c_str(), "/dev/bus/usb/%d/%d", &event->device.busNumber, &event->device.deviceAddress);
+	event->isOverflow = false;
+	event->systemDelay = 0;
+
+	return true;
+}
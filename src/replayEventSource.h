@@ -0,0 +1,66 @@
+#ifndef _REPLAY_EVENT_SOURCE_H
+#define _REPLAY_EVENT_SOURCE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "eventSource.h"
+
+#define REPLAY_FILE_ENV "USB_DETECTION_REPLAY"
+#define REPLAY_RATE_ENV "USB_DETECTION_REPLAY_RATE"
+
+/*
+ * Plays back add/remove records from a file instead of watching hardware,
+ * one per line:
+ *
+ *   <add|remove> <devnode> <idVendor> <idProduct> [ID_MODEL [ID_VENDOR [ID_SERIAL_SHORT]]]
+ *   overflow <count>
+ *
+ * `overflow` loses the next `count` records the way a full netlink socket
+ * would: they are never delivered, but Enumerate reports the devices as
+ * they are after them.
+ *
+ * Ids are hex and the strings follow udev's convention of replacing
+ * spaces with underscores. Blank lines, lines starting with `#` and
+ * other udev actions are skipped.
+ *
+ * With a rate of 0 records are delivered as fast as the monitor takes
+ * them, otherwise they are paced to `rate` records per second.
+ */
+class ReplayEventSource : public DeviceEventSource {
+	public:
+		ReplayEventSource(const std::string& path, double rate);
+
+		// Reads the path and rate from REPLAY_FILE_ENV and REPLAY_RATE_ENV.
+		// Returns NULL when no replay file is set.
+		static ReplayEventSource* FromEnvironment();
+
+		bool Open();
+		void Enumerate(std::vector<DeviceSourceEvent_t>* devices);
+		bool Receive(DeviceSourceEvent_t* event);
+		void Interrupt();
+
+	private:
+		bool ParseRecord(const std::string& line, DeviceSourceEvent_t* event);
+		bool ParseOverflow(const std::string& line, unsigned long* lost);
+		// Keeps `present` in step with every record read, delivered or not
+		void TrackRecord(const DeviceSourceEvent_t& event);
+
+		std::string path;
+		double rate;
+		std::ifstream file;
+		unsigned long delivered;
+		std::map<std::string, DeviceSourceEvent_t> present;
+		std::chrono::steady_clock::time_point start;
+
+		// Pacing waits on this so Interrupt doesn't have to wait out the gap
+		std::mutex interruptMutex;
+		std::condition_variable interruptCondition;
+		bool interrupted;
+};
+
+#endif
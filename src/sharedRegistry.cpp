@@ -0,0 +1,496 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sharedRegistry.h"
+
+using namespace std;
+
+#define SHARED_MAGIC 0x55534252
+#define SHARED_VERSION 2
+
+#define SHARED_ATTACH_TIMEOUT_MS 1000
+#define SHARED_ATTACH_RETRY_MS 10
+#define SHARED_INTERRUPT_RETRY_MS 1
+// Yields a reader spends on an odd seqlock between checks for a dead owner
+#define SHARED_UPDATE_SPINS 10000
+
+
+/**********************************
+ * Local Helper Functions
+ **********************************/
+void CopyString(char* destination, size_t size, const char* value) {
+	strncpy(destination, value ? value : "", size - 1);
+	destination[size - 1] = '\0';
+}
+
+void ToShared(const DeviceSourceEvent_t& event, SharedDevice_t* device) {
+	device->locationId = event.device.locationId;
+	device->vendorId = event.device.vendorId;
+	device->productId = event.device.productId;
+	device->deviceAddress = event.device.deviceAddress;
+	device->busNumber = event.device.busNumber;
+	CopyString(device->key, sizeof(device->key), event.key.c_str());
+	CopyString(device->deviceName, sizeof(device->deviceName), event.device.deviceName.c_str());
+	CopyString(device->manufacturer, sizeof(device->manufacturer), event.device.manufacturer.c_str());
+	CopyString(device->serialNumber, sizeof(device->serialNumber), event.device.serialNumber.c_str());
+	CopyString(device->portPath, sizeof(device->portPath), event.device.portPath.c_str());
+}
+
+void FromShared(const SharedDevice_t& device, bool isAdded, DeviceSourceEvent_t* event) {
+	event->isOverflow = false;
+	event->isAdded = isAdded;
+	event->key = device.key;
+	event->device = ListResultItem_t();
+	event->device.locationId = device.locationId;
+	event->device.vendorId = device.vendorId;
+	event->device.productId = device.productId;
+	event->device.deviceAddress = device.deviceAddress;
+	event->device.busNumber = device.busNumber;
+	event->device.deviceName = device.deviceName;
+	event->device.manufacturer = device.manufacturer;
+	event->device.serialNumber = device.serialNumber;
+	event->device.portPath = device.portPath;
+	event->systemDelay = 0;
+}
+
+void SetOverflow(DeviceSourceEvent_t* event) {
+	*event = DeviceSourceEvent_t();
+	event->isOverflow = true;
+}
+
+void SleepMilliseconds(long milliseconds) {
+	struct timespec delay;
+	delay.tv_sec = milliseconds / 1000;
+	delay.tv_nsec = (milliseconds % 1000) * 1000000;
+	nanosleep(&delay, NULL);
+}
+
+
+/**********************************
+ * Public Functions
+ **********************************/
+SharedRegistrySource::SharedRegistrySource(const string& name, MonitorFactory_t createMonitor)
+	: name(name), createMonitor(createMonitor), fd(-1), region(NULL), isOwner(false), monitor(NULL), interrupted(false), isReceiving(false), position(0) {
+	// shm_open wants a single leading slash
+	if (this->name.empty() || this->name[0] != '/') {
+		this->name.insert(0, "/");
+	}
+}
+
+SharedRegistrySource::~SharedRegistrySource() {
+	delete monitor.load();
+
+	// The segment itself stays for the other processes; closing the fd
+	// hands the lock to one of them
+	if (region != NULL) {
+		munmap(region, sizeof(SharedRegion_t));
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+SharedRegistrySource* SharedRegistrySource::FromEnvironment(MonitorFactory_t createMonitor) {
+	const char* name = getenv(SHARED_REGISTRY_ENV);
+	if (name == NULL || *name == '\0') {
+		return NULL;
+	}
+
+	return new SharedRegistrySource(name, createMonitor);
+}
+
+bool SharedRegistrySource::Open() {
+	fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		printf("Can't open shared registry %s\n", name.c_str());
+		return false;
+	}
+
+	if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+		return TakeOwnership();
+	}
+
+	return Attach();
+}
+
+void SharedRegistrySource::Enumerate(vector<DeviceSourceEvent_t>* devices) {
+	if (isOwner) {
+		monitor.load()->Enumerate(devices);
+
+		// Republished from scratch, and readers are told to catch up on
+		// the whole table since the changes in between are unknown
+		BeginUpdate();
+		slots.clear();
+		uint32_t count = 0;
+		uint32_t truncated = 0;
+		for (size_t i = 0; i < devices->size(); i++) {
+			if (slots.count((*devices)[i].key) > 0) {
+				continue;
+			}
+			if (count == SHARED_DEVICE_CAPACITY) {
+				truncated++;
+				continue;
+			}
+			slots[(*devices)[i].key] = count;
+			ToShared((*devices)[i], &region->devices[count]);
+			count++;
+		}
+		region->count = count;
+		region->truncated = truncated;
+		WriteEvent(Shared_Resync, NULL);
+		EndUpdate();
+		Wake();
+
+		return;
+	}
+
+	vector<SharedDevice_t> copied;
+	uint64_t head;
+	uint32_t truncated;
+	for (unsigned long spins = 1; ; spins++) {
+		// No region left if a failed takeover couldn't attach again
+		if (interrupted || region == NULL) {
+			return;
+		}
+
+		uint64_t sequence = region->sequence.load(memory_order_acquire);
+		if (sequence & 1) {
+			// An owner that died mid-update never finishes it, so once in
+			// a while check whether the lock is free to take over
+			if (spins % SHARED_UPDATE_SPINS == 0 && flock(fd, LOCK_EX | LOCK_NB) == 0) {
+				if (TakeOwnership()) {
+					Enumerate(devices);
+					return;
+				}
+				Attach();
+				continue;
+			}
+			sched_yield();
+			continue;
+		}
+
+		uint32_t count = region->count;
+		copied.assign(region->devices, region->devices + min(count, (uint32_t) SHARED_DEVICE_CAPACITY));
+		head = region->eventHead;
+		truncated = region->truncated;
+
+		atomic_thread_fence(memory_order_acquire);
+		if (region->sequence.load(memory_order_relaxed) == sequence) {
+			break;
+		}
+	}
+
+	position = head;
+
+	// Taken after the head, so changes in between are seen twice rather
+	// than missed; the monitor thread skips adds it already has
+	if (truncated > 0) {
+		DeviceEventSource* own = createMonitor();
+		bool opened = own->Open();
+		if (opened) {
+			own->Enumerate(devices);
+		}
+		delete own;
+		if (opened) {
+			return;
+		}
+	}
+
+	for (size_t i = 0; i < copied.size(); i++) {
+		DeviceSourceEvent_t device;
+		FromShared(copied[i], true, &device);
+		devices->push_back(device);
+	}
+}
+
+bool SharedRegistrySource::Receive(DeviceSourceEvent_t* event) {
+	// Set before `interrupted` is checked, so either Interrupt sees it or
+	// we see the interrupt
+	isReceiving = true;
+	bool result = ReceiveEvent(event);
+	isReceiving = false;
+
+	return result;
+}
+
+void SharedRegistrySource::Interrupt() {
+	interrupted = true;
+
+	DeviceEventSource* current = monitor.load();
+	if (current != NULL) {
+		current->Interrupt();
+		return;
+	}
+
+	// A reader that checked `interrupted` just before it was set misses a
+	// wakeup sent before it starts waiting, and would sleep out the whole
+	// SHARED_OWNER_CHECK_MS. So keep waking until it is out of Receive.
+	while (region != NULL && isReceiving) {
+		Wake();
+		SleepMilliseconds(SHARED_INTERRUPT_RETRY_MS);
+	}
+}
+
+bool SharedRegistrySource::IsOwner() const {
+	return isOwner;
+}
+
+
+/**********************************
+ * Private Functions
+ **********************************/
+bool SharedRegistrySource::Attach() {
+	for (int waited = 0; waited < SHARED_ATTACH_TIMEOUT_MS; waited += SHARED_ATTACH_RETRY_MS) {
+		struct stat info;
+		if (region == NULL && fstat(fd, &info) == 0 && (size_t) info.st_size == sizeof(SharedRegion_t)) {
+			void* data = mmap(NULL, sizeof(SharedRegion_t), PROT_READ, MAP_SHARED, fd, 0);
+			if (data != MAP_FAILED) {
+				region = (SharedRegion_t*) data;
+			}
+		}
+
+		if (region != NULL && region->magic.load(memory_order_acquire) == SHARED_MAGIC && region->version == SHARED_VERSION) {
+			return true;
+		}
+
+		SleepMilliseconds(SHARED_ATTACH_RETRY_MS);
+	}
+
+	printf("Shared registry %s has no owner\n", name.c_str());
+	return false;
+}
+
+bool SharedRegistrySource::TakeOwnership() {
+	if (region != NULL) {
+		munmap(region, sizeof(SharedRegion_t));
+		region = NULL;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || ((size_t) info.st_size != sizeof(SharedRegion_t) && ftruncate(fd, sizeof(SharedRegion_t)) != 0)) {
+		printf("Can't size shared registry %s\n", name.c_str());
+		return AbandonTakeover();
+	}
+
+	void* data = mmap(NULL, sizeof(SharedRegion_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		printf("Can't map shared registry %s\n", name.c_str());
+		return AbandonTakeover();
+	}
+	region = (SharedRegion_t*) data;
+
+	// A region a previous owner laid out is carried on from, so readers
+	// already tailing it keep their place
+	if (region->magic.load(memory_order_acquire) != SHARED_MAGIC || region->version != SHARED_VERSION) {
+		memset((void*) region, 0, sizeof(SharedRegion_t));
+		region->version = SHARED_VERSION;
+		region->magic.store(SHARED_MAGIC, memory_order_release);
+	}
+	else {
+		// The previous owner may have died halfway through an update. The
+		// event it was writing is finished as a resync, which readers
+		// waiting on that slot act on, and the seqlock is made even again
+		// so they can read the table that the rescan then republishes.
+		uint64_t head = region->eventHead;
+		SharedEvent_t& slot = region->events[head & (SHARED_EVENT_CAPACITY - 1)];
+		if (slot.sequence.load(memory_order_relaxed) > head * 2) {
+			slot.type = Shared_Resync;
+			slot.sequence.store(head * 2 + 2, memory_order_release);
+			region->eventHead = head + 1;
+		}
+		if (region->sequence.load(memory_order_relaxed) & 1) {
+			region->sequence.fetch_add(1, memory_order_release);
+		}
+	}
+	region->ownerPid = getpid();
+
+	DeviceEventSource* created = createMonitor();
+	if (!created->Open()) {
+		delete created;
+		return AbandonTakeover();
+	}
+
+	isOwner = true;
+	monitor = created;
+	// Interrupt may have run before there was a monitor to pass it on to
+	if (interrupted) {
+		created->Interrupt();
+	}
+
+	return true;
+}
+
+bool SharedRegistrySource::ReceiveEvent(DeviceSourceEvent_t* event) {
+	while (!interrupted && region != NULL) {
+		if (isOwner) {
+			return ReceiveAsOwner(event);
+		}
+
+		// Read before looking at the ring, so an event published in
+		// between makes the wait below return straight away
+		uint32_t wakeCount = region->wakeCount.load(memory_order_acquire);
+
+		SharedEvent_t& slot = region->events[position & (SHARED_EVENT_CAPACITY - 1)];
+		uint64_t expected = position * 2 + 2;
+		uint64_t sequence = slot.sequence.load(memory_order_acquire);
+
+		if (sequence == expected) {
+			uint32_t type = slot.type;
+			SharedDevice_t device = slot.device;
+
+			atomic_thread_fence(memory_order_acquire);
+			if (slot.sequence.load(memory_order_relaxed) == expected) {
+				position++;
+				if (type == Shared_Resync) {
+					SetOverflow(event);
+				}
+				else {
+					FromShared(device, type == Shared_Added, event);
+				}
+				return true;
+			}
+			continue;
+		}
+
+		// The owner has lapped us, what we missed is gone
+		if (sequence > expected) {
+			SetOverflow(event);
+			return true;
+		}
+
+		if (!WaitForEvent(wakeCount) && flock(fd, LOCK_EX | LOCK_NB) == 0) {
+			// The owner is gone. Take over and rescan so the table is
+			// republished. If that fails someone else may manage, and
+			// until then this carries on reading.
+			if (!TakeOwnership()) {
+				if (!Attach()) {
+					return false;
+				}
+				continue;
+			}
+			SetOverflow(event);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool SharedRegistrySource::AbandonTakeover() {
+	if (region != NULL) {
+		munmap(region, sizeof(SharedRegion_t));
+		region = NULL;
+	}
+	flock(fd, LOCK_UN);
+
+	return false;
+}
+
+bool SharedRegistrySource::ReceiveAsOwner(DeviceSourceEvent_t* event) {
+	if (!monitor.load()->Receive(event)) {
+		return false;
+	}
+
+	// The monitor thread enumerates next, which republishes everything
+	if (event->isOverflow) {
+		return true;
+	}
+
+	SharedDevice_t device;
+	ToShared(*event, &device);
+
+	BeginUpdate();
+	unordered_map<string, uint32_t>::iterator it = slots.find(event->key);
+	if (event->isAdded) {
+		if (it != slots.end()) {
+			region->devices[it->second] = device;
+		}
+		else if (region->count < SHARED_DEVICE_CAPACITY) {
+			slots[event->key] = region->count;
+			region->devices[region->count++] = device;
+		}
+		else {
+			region->truncated++;
+		}
+		WriteEvent(Shared_Added, &device);
+	}
+	else {
+		// The table's copy was read while the device was still there, so
+		// it beats what a removal carries
+		if (it != slots.end()) {
+			uint32_t index = it->second;
+			uint32_t last = region->count - 1;
+			device = region->devices[index];
+
+			slots.erase(it);
+			if (index != last) {
+				region->devices[index] = region->devices[last];
+				slots[region->devices[index].key] = index;
+			}
+			region->count--;
+		}
+		else if (region->truncated > 0) {
+			region->truncated--;
+		}
+		WriteEvent(Shared_Removed, &device);
+	}
+	EndUpdate();
+	Wake();
+
+	return true;
+}
+
+void SharedRegistrySource::BeginUpdate() {
+	region->sequence.fetch_add(1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+void SharedRegistrySource::EndUpdate() {
+	region->sequence.fetch_add(1, memory_order_release);
+}
+
+void SharedRegistrySource::WriteEvent(SharedEventType_t type, const SharedDevice_t* device) {
+	uint64_t head = region->eventHead;
+	SharedEvent_t& slot = region->events[head & (SHARED_EVENT_CAPACITY - 1)];
+
+	slot.sequence.store(head * 2 + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	slot.type = type;
+	if (device != NULL) {
+		slot.device = *device;
+	}
+	slot.sequence.store(head * 2 + 2, memory_order_release);
+
+	region->eventHead = head + 1;
+}
+
+bool SharedRegistrySource::WaitForEvent(uint32_t wakeCount) {
+	struct timespec timeout;
+	timeout.tv_sec = SHARED_OWNER_CHECK_MS / 1000;
+	timeout.tv_nsec = (SHARED_OWNER_CHECK_MS % 1000) * 1000000;
+
+	// Not FUTEX_PRIVATE_FLAG: the waiters are in other processes
+	long result = syscall(SYS_futex, &region->wakeCount, FUTEX_WAIT, wakeCount, &timeout, NULL, 0);
+
+	return result == 0 || errno != ETIMEDOUT;
+}
+
+void SharedRegistrySource::Wake() {
+	// Readers have it mapped read-only, but waking only needs the address
+	if (isOwner) {
+		region->wakeCount.fetch_add(1, memory_order_release);
+	}
+	syscall(SYS_futex, &region->wakeCount, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
@@ -0,0 +1,148 @@
+#ifndef _SHARED_REGISTRY_H
+#define _SHARED_REGISTRY_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "eventSource.h"
+
+#define SHARED_REGISTRY_ENV "USB_DETECTION_SHARED"
+
+#define SHARED_DEVICE_CAPACITY 512
+// A power of two, so positions map onto slots with a mask
+#define SHARED_EVENT_CAPACITY 1024
+#define SHARED_KEY_LENGTH 64
+#define SHARED_STRING_LENGTH 128
+// How long a reader waits for events before checking the owner is alive
+#define SHARED_OWNER_CHECK_MS 1000
+
+typedef enum {
+	Shared_Added,
+	Shared_Removed,
+	// The owner rescanned; readers have to enumerate again
+	Shared_Resync
+} SharedEventType_t;
+
+// Strings are truncated to fit and always NUL terminated
+typedef struct {
+	int32_t locationId;
+	int32_t vendorId;
+	int32_t productId;
+	int32_t deviceAddress;
+	int32_t busNumber;
+	char key[SHARED_KEY_LENGTH];
+	char deviceName[SHARED_STRING_LENGTH];
+	char manufacturer[SHARED_STRING_LENGTH];
+	char serialNumber[SHARED_STRING_LENGTH];
+	char portPath[SHARED_KEY_LENGTH];
+} SharedDevice_t;
+
+typedef struct {
+	// 2n + 1 while event n is being written into the slot, 2n + 2 once
+	// it is complete
+	std::atomic<uint64_t> sequence;
+	uint32_t type;
+	SharedDevice_t device;
+} SharedEvent_t;
+
+typedef struct {
+	// Set last when the owner first lays the region out
+	std::atomic<uint32_t> magic;
+	uint32_t version;
+	std::atomic<uint32_t> ownerPid;
+	// Bumped after every event, readers wait on it with a futex
+	std::atomic<uint32_t> wakeCount;
+
+	// Seqlock over everything below it: odd while the owner is updating
+	std::atomic<uint64_t> sequence;
+	// Number of events written. The device table is the result of
+	// exactly those, so a reader resumes tailing the ring from here.
+	uint64_t eventHead;
+	uint32_t count;
+	// Devices the owner has that didn't fit in the table. The ring still
+	// carries their changes.
+	uint32_t truncated;
+	SharedDevice_t devices[SHARED_DEVICE_CAPACITY];
+
+	SharedEvent_t events[SHARED_EVENT_CAPACITY];
+} SharedRegion_t;
+
+/*
+ * Lets every process on a host share one udev monitor through a POSIX
+ * shared memory segment.
+ *
+ * Whichever process holds an flock on the segment is the owner. It runs
+ * the real monitor, passes its devices and changes through, and publishes
+ * them to the segment as a device table under a seqlock plus a ring of
+ * events. Every other process maps the segment read-only: Enumerate copies
+ * the table, and Receive tails the ring from where that copy left off. If
+ * the owner has more than SHARED_DEVICE_CAPACITY devices, readers
+ * enumerate with a monitor of their own instead.
+ *
+ * A reader that falls a whole ring behind reports an overflow, and the
+ * monitor thread enumerates again, just as it does when the kernel drops
+ * uevents. When the owner goes away (or stops monitoring) one of the
+ * readers takes the lock within SHARED_OWNER_CHECK_MS and becomes the new
+ * owner.
+ */
+class SharedRegistrySource : public DeviceEventSource {
+	public:
+		typedef DeviceEventSource* (*MonitorFactory_t)();
+
+		// `createMonitor` makes the source the owner watches, and the one a
+		// reader enumerates with when the table is full
+		SharedRegistrySource(const std::string& name, MonitorFactory_t createMonitor);
+		~SharedRegistrySource();
+
+		// Reads the segment's name from SHARED_REGISTRY_ENV. Returns NULL
+		// when it isn't set.
+		static SharedRegistrySource* FromEnvironment(MonitorFactory_t createMonitor);
+
+		bool Open();
+		void Enumerate(std::vector<DeviceSourceEvent_t>* devices);
+		bool Receive(DeviceSourceEvent_t* event);
+		void Interrupt();
+
+		bool IsOwner() const;
+
+	private:
+		// Waits for the owner to lay the region out, then maps it read-only
+		bool Attach();
+		// Called with the lock held: maps the region writable and starts
+		// the monitor
+		bool TakeOwnership();
+		// Unmaps the region and lets the lock go after a takeover failed,
+		// so another process can try. Always returns false.
+		bool AbandonTakeover();
+
+		// Receive, between setting and clearing isReceiving
+		bool ReceiveEvent(DeviceSourceEvent_t* event);
+		bool ReceiveAsOwner(DeviceSourceEvent_t* event);
+		void BeginUpdate();
+		void EndUpdate();
+		void WriteEvent(SharedEventType_t type, const SharedDevice_t* device);
+
+		// Returns false if no event was published before the timeout
+		bool WaitForEvent(uint32_t wakeCount);
+		void Wake();
+
+		std::string name;
+		MonitorFactory_t createMonitor;
+		int fd;
+		SharedRegion_t* region;
+		bool isOwner;
+		std::atomic<DeviceEventSource*> monitor;
+		std::atomic<bool> interrupted;
+		// Set while Receive runs, for Interrupt to wait on
+		std::atomic<bool> isReceiving;
+
+		// Owner: where each key sits in the device table
+		std::unordered_map<std::string, uint32_t> slots;
+		// Reader: the next event to read from the ring
+		uint64_t position;
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef _SLAB_POOL_H
+#define _SLAB_POOL_H
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cstddef>
+
+#define SLAB_POOL_OBJECTS_PER_SLAB 64
+
+// Running totals of what every pool has handed out, recycled or not, so
+// the allocation benchmarks can see past the free lists
+typedef struct {
+	std::atomic<size_t> allocations;
+	std::atomic<size_t> bytes;
+} SlabPoolStats_t;
+
+inline SlabPoolStats_t& GetSlabPoolStats() {
+	static SlabPoolStats_t stats;
+	return stats;
+}
+
+/*
+ * Fixed-size allocator for device records.
+ *
+ * Objects are carved out of slabs and recycled through a free list, so
+ * steady hotplug traffic stops hitting malloc once the pool has warmed
+ * up. Slabs are never handed back: the device population of a host stays
+ * roughly the same size.
+ */
+template <size_t Size>
+class SlabPool {
+	public:
+		// Leaked on purpose, records can still be freed during static destruction
+		static SlabPool& Instance() {
+			static SlabPool* pool = new SlabPool();
+			return *pool;
+		}
+
+		void* Allocate() {
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if(freeList == NULL) {
+				Grow();
+			}
+
+			FreeNode_t* node = freeList;
+			freeList = node->next;
+
+			GetSlabPoolStats().allocations.fetch_add(1, std::memory_order_relaxed);
+			GetSlabPoolStats().bytes.fetch_add(Size, std::memory_order_relaxed);
+
+			return node;
+		}
+
+		void Free(void* ptr) {
+			if(ptr == NULL) {
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+
+			FreeNode_t* node = static_cast<FreeNode_t*>(ptr);
+			node->next = freeList;
+			freeList = node;
+		}
+
+	private:
+		union FreeNode_t {
+			FreeNode_t* next;
+			alignas(alignof(std::max_align_t)) char storage[Size];
+		};
+
+		SlabPool() : freeList(NULL) {}
+
+		void Grow() {
+			FreeNode_t* slab = static_cast<FreeNode_t*>(::operator new(sizeof(FreeNode_t) * SLAB_POOL_OBJECTS_PER_SLAB));
+
+			for(int i = 0; i < SLAB_POOL_OBJECTS_PER_SLAB; i++) {
+				slab[i].next = freeList;
+				freeList = &slab[i];
+			}
+		}
+
+		std::mutex mutex;
+		FreeNode_t* freeList;
+};
+
+// Standard allocator that serves single objects from the SlabPool for their size
+template <typename T>
+class PoolAllocator {
+	public:
+		typedef T value_type;
+
+		PoolAllocator() {}
+		template <typename U> PoolAllocator(const PoolAllocator<U>&) {}
+
+		T* allocate(size_t n) {
+			if(n != 1) {
+				return static_cast<T*>(::operator new(n * sizeof(T)));
+			}
+
+			return static_cast<T*>(SlabPool<sizeof(T)>::Instance().Allocate());
+		}
+
+		void deallocate(T* ptr, size_t n) {
+			if(n != 1) {
+				::operator delete(ptr);
+				return;
+			}
+
+			SlabPool<sizeof(T)>::Instance().Free(ptr);
+		}
+
+		template <typename U> bool operator==(const PoolAllocator<U>&) const { return true; }
+		template <typename U> bool operator!=(const PoolAllocator<U>&) const { return false; }
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "subscriptionTable.h"
+#include "deviceList.h"
+
+using namespace std;
+
+unsigned int SubscriptionTable::Add(int vid, int pid, int changeMask) {
+	Subscription_t subscription;
+	subscription.id = nextId++;
+	subscription.vendorId = vid;
+	subscription.productId = vid == 0 ? 0 : pid;
+	subscription.changeMask = changeMask;
+
+	long long key = GetProductKey(subscription.vendorId, subscription.productId);
+	byKey[key].push_back(subscription);
+	keysById[subscription.id] = key;
+
+	return subscription.id;
+}
+
+bool SubscriptionTable::Remove(unsigned int id) {
+	unordered_map<unsigned int, long long>::iterator found = keysById.find(id);
+	if (found == keysById.end()) {
+		return false;
+	}
+
+	unordered_map<long long, vector<Subscription_t> >::iterator bucket = byKey.find(found->second);
+	for (vector<Subscription_t>::iterator it = bucket->second.begin(); it != bucket->second.end(); ++it) {
+		if (it->id == id) {
+			bucket->second.erase(it);
+			break;
+		}
+	}
+	if (bucket->second.empty()) {
+		byKey.erase(bucket);
+	}
+	keysById.erase(found);
+
+	return true;
+}
+
+void SubscriptionTable::Match(int vid, int pid, int change, vector<unsigned int>* ids) const {
+	if (byKey.empty()) {
+		return;
+	}
+
+	MatchKey(GetProductKey(vid, pid), change, ids);
+	if (pid != 0) {
+		MatchKey(GetProductKey(vid, 0), change, ids);
+	}
+	if (vid != 0) {
+		MatchKey(GetProductKey(0, 0), change, ids);
+	}
+}
+
+void SubscriptionTable::MatchKey(long long key, int change, vector<unsigned int>* ids) const {
+	unordered_map<long long, vector<Subscription_t> >::const_iterator bucket = byKey.find(key);
+	if (bucket == byKey.end()) {
+		return;
+	}
+
+	for (vector<Subscription_t>::const_iterator it = bucket->second.begin(); it != bucket->second.end(); ++it) {
+		if (it->changeMask & change) {
+			ids->push_back(it->id);
+		}
+	}
+}
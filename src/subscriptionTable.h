@@ -0,0 +1,45 @@
+#ifndef _SUBSCRIPTION_TABLE_H
+#define _SUBSCRIPTION_TABLE_H
+
+#include <unordered_map>
+#include <vector>
+
+#define CHANGE_MASK_ADDED 1
+#define CHANGE_MASK_REMOVED 2
+
+typedef struct {
+	unsigned int id;
+	int vendorId;
+	int productId;
+	int changeMask;
+} Subscription_t;
+
+/*
+ * Who wants to hear about which devices.
+ *
+ * A subscription is for one vendor and product, every product of one
+ * vendor (productId 0) or every device (vendorId 0). Subscriptions are
+ * bucketed by that key, so matching a change is at most three hash
+ * lookups however many subscriptions there are.
+ */
+class SubscriptionTable {
+	public:
+		SubscriptionTable() : nextId(1) {}
+
+		// Returns the new subscription's id, never 0 and never reused
+		unsigned int Add(int vid, int pid, int changeMask);
+		bool Remove(unsigned int id);
+
+		// Appends the ids of the subscriptions that match, the most
+		// specific first and otherwise in the order they were added
+		void Match(int vid, int pid, int change, std::vector<unsigned int>* ids) const;
+
+	private:
+		void MatchKey(long long key, int change, std::vector<unsigned int>* ids) const;
+
+		std::unordered_map<long long, std::vector<Subscription_t> > byKey;
+		std::unordered_map<unsigned int, long long> keysById;
+		unsigned int nextId;
+};
+
+#endif
@@ -0,0 +1,466 @@
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <thread>
+#include <libudev.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "eventSource.h"
+#include "registrySnapshot.h"
+#include "replayEventSource.h"
+#include "sharedRegistry.h"
+
+using namespace std;
+
+
+/**********************************
+ * Local defines
+ **********************************/
+#define DEVICE_ACTION_ADDED "add"
+#define DEVICE_ACTION_REMOVED "remove"
+
+#define DEVICE_SUBSYSTEM "usb"
+#define DEVICE_TYPE_DEVICE "usb_device"
+#define DEVICE_PROPERTY_DEVTYPE "DEVTYPE"
+
+#define DEVICE_PROPERTY_NAME "ID_MODEL"
+#define DEVICE_PROPERTY_SERIAL "ID_SERIAL_SHORT"
+#define DEVICE_PROPERTY_VENDOR "ID_VENDOR"
+#define DEVICE_PROPERTY_VENDOR_ID "ID_VENDOR_ID"
+#define DEVICE_PROPERTY_PRODUCT_ID "ID_MODEL_ID"
+
+#define DEVICE_NODE_FORMAT "/dev/bus/usb/%d/%d"
+
+// Room for a few thousand queued uevents while the monitor thread is busy,
+// e.g. when a hub full of devices re-enumerates at once
+#define RECEIVE_BUFFER_ENV "USB_DETECTION_RECEIVE_BUFFER"
+#define RECEIVE_BUFFER_DEFAULT_SIZE (4 * 1024 * 1024)
+
+#define ENUMERATE_MAX_THREADS 4
+#define ENUMERATE_DEVICES_PER_THREAD 16
+
+#define POLL_MAX_EVENTS 8
+
+
+/**********************************
+ * Local typedefs
+ **********************************/
+// What woke the monitor thread, as tagged on each fd in the epoll set. A
+// new kind of event (mount points, say) gets a tag and an fd of its own.
+typedef enum {
+	Wake_Interrupt,
+	Wake_Monitor
+} WakeReason_t;
+
+class UdevEventSource : public DeviceEventSource {
+	public:
+		UdevEventSource();
+		~UdevEventSource();
+
+		bool Open();
+		void Enumerate(vector<DeviceSourceEvent_t>* devices);
+		bool Receive(DeviceSourceEvent_t* event);
+		void Interrupt();
+
+	private:
+		// Throws away whatever is still waiting on the socket
+		void Drain();
+		bool AddToPoll(int fd, WakeReason_t reason);
+		// Sleeps until the monitor has something to read. Returns false
+		// once interrupted.
+		bool WaitForMonitor();
+
+		struct udev *udev;
+		struct udev_monitor *mon;
+		// The monitor thread only ever blocks in epoll_wait, and
+		// Interrupt wakes it through the eventfd
+		int pollFd;
+		int interruptFd;
+		std::atomic<bool> interrupted;
+};
+
+
+/**********************************
+ * Local Helper Functions
+ **********************************/
+// Enumeration and events both read sysfs first, so a device looks the same
+// whichever way it was found. udev's properties are the fallback for when
+// sysfs is already gone, as it is for a removal.
+const char* GetDeviceString(struct udev_device* dev, const char* attribute, const char* property) {
+	const char* value = udev_device_get_sysattr_value(dev, attribute);
+
+	return value ? value : udev_device_get_property_value(dev, property);
+}
+
+int GetDeviceHex(struct udev_device* dev, const char* attribute, const char* property) {
+	const char* value = GetDeviceString(dev, attribute, property);
+
+	return value ? strtol(value, NULL, 16) : 0;
+}
+
+// Packs the bus and hub ports the way macOS does: the bus in the top
+// byte, then one nibble per port, e.g. 1-1.4 is 0x01140000
+int GetLocationId(int bus, const char* portPath) {
+	unsigned int locationId = (unsigned int) (bus & 0xff) << 24;
+
+	const char* ports = strchr(portPath, '-');
+	int shift = 20;
+	while (ports != NULL && shift >= 0) {
+		locationId |= (unsigned int) (strtol(ports + 1, NULL, 10) & 0xf) << shift;
+		ports = strchr(ports + 1, '.');
+		shift -= 4;
+	}
+
+	return (int) locationId;
+}
+
+// Fills in everything a device list entry holds. The topology comes from
+// names udev already has, so none of it costs a sysfs read.
+void ReadDeviceFields(struct udev_device* dev, ListResultItem_t* item) {
+	item->vendorId = GetDeviceHex(dev, "idVendor", DEVICE_PROPERTY_VENDOR_ID);
+	item->productId = GetDeviceHex(dev, "idProduct", DEVICE_PROPERTY_PRODUCT_ID);
+	item->deviceName = GetDeviceString(dev, "product", DEVICE_PROPERTY_NAME);
+	item->manufacturer = GetDeviceString(dev, "manufacturer", DEVICE_PROPERTY_VENDOR);
+	item->serialNumber = GetDeviceString(dev, "serial", DEVICE_PROPERTY_SERIAL);
+
+	int bus = 0;
+	int address = 0;
+	const char* devnode = udev_device_get_devnode(dev);
+	if (devnode) {
+		sscanf(devnode, DEVICE_NODE_FORMAT, &bus, &address);
+	}
+
+	const char* sysname = udev_device_get_sysname(dev);
+	item->busNumber = bus;
+	item->deviceAddress = address;
+	item->portPath = sysname ? sysname : "";
+	item->locationId = GetLocationId(bus, item->portPath.c_str());
+}
+
+
+DeviceEventSource* CreateUdevEventSource() {
+	return new UdevEventSource();
+}
+
+// Reads every `stride`th of the `unread` entries starting at `first` from
+// its /sys entry
+void ReadDevices(vector<SnapshotEntry_t>* entries, const vector<size_t>* unread, size_t first, size_t stride) {
+	struct udev *context = udev_new();
+	if (!context) {
+		return;
+	}
+
+	for (size_t i = first; i < unread->size(); i += stride) {
+		SnapshotEntry_t& entry = (*entries)[(*unread)[i]];
+
+		/* Create a udev_device object (dev) representing the
+		   /sys entry for the device */
+		struct udev_device *dev = udev_device_new_from_syspath(context, entry.syspath.c_str());
+		if (!dev) {
+			continue;
+		}
+
+		/* From here, we can call get_sysattr_value() for each file
+		   in the device's /sys entry. The strings passed into these
+		   functions (idProduct, idVendor, serial, etc.) correspond
+		   directly to the files in the /sys directory which
+		   represents the USB device. Note that USB strings are
+		   Unicode, UCS2 encoded, but the strings returned from
+		   udev_device_get_sysattr_value() are UTF-8 encoded. */
+		const char* devnode = udev_device_get_devnode(dev);
+		const char* vendorId = udev_device_get_sysattr_value(dev, "idVendor");
+
+		/* usb_device_get_devnode() returns the path to the device node
+		   itself in /dev. */
+		if (devnode != NULL && vendorId != NULL) {
+			DeviceSourceEvent_t& device = entry.device;
+			device.isOverflow = false;
+			device.isAdded = true;
+			device.key = devnode;
+			device.device = ListResultItem_t();
+			ReadDeviceFields(dev, &device.device);
+			device.systemDelay = 0;
+		}
+
+		udev_device_unref(dev);
+	}
+
+	udev_unref(context);
+}
+
+
+/**********************************
+ * Public Functions
+ **********************************/
+DeviceEventSource* CreateDeviceEventSource() {
+	// Lets applications drive their hotplug paths in CI without hardware
+	DeviceEventSource* replay = ReplayEventSource::FromEnvironment();
+	if (replay) {
+		return replay;
+	}
+
+	// One process on the host watches udev for all of them
+	DeviceEventSource* shared = SharedRegistrySource::FromEnvironment(CreateUdevEventSource);
+	if (shared) {
+		return shared;
+	}
+
+	return CreateUdevEventSource();
+}
+
+UdevEventSource::UdevEventSource() : udev(NULL), mon(NULL), pollFd(-1), interruptFd(-1), interrupted(false) {
+}
+
+UdevEventSource::~UdevEventSource() {
+	// Closing the monitor's socket is what stops the kernel queueing
+	// uevents for us
+	if (pollFd >= 0) {
+		close(pollFd);
+	}
+	if (interruptFd >= 0) {
+		close(interruptFd);
+	}
+	if (mon) {
+		udev_monitor_unref(mon);
+	}
+	if (udev) {
+		udev_unref(udev);
+	}
+}
+
+bool UdevEventSource::Open() {
+	/* Create the udev object */
+	udev = udev_new();
+	if (!udev)
+	{
+		printf("Can't create udev\n");
+		return false;
+	}
+
+	/* Set up a monitor to monitor devices. The match is compiled into a
+	   socket filter, so the kernel drops every other subsystem's uevents
+	   before they ever wake the monitor thread. */
+	mon = udev_monitor_new_from_netlink(udev, "udev");
+	udev_monitor_filter_add_match_subsystem_devtype(mon, DEVICE_SUBSYSTEM, DEVICE_TYPE_DEVICE);
+
+	/* The default buffer holds a few hundred uevents. libudev forces the
+	   size past net.core.rmem_max, which needs CAP_NET_ADMIN; without it
+	   we settle for as much as the limit allows. */
+	const char* bufferSize = getenv(RECEIVE_BUFFER_ENV);
+	int size = bufferSize ? atoi(bufferSize) : RECEIVE_BUFFER_DEFAULT_SIZE;
+	if (size > 0 && udev_monitor_set_receive_buffer_size(mon, size) < 0) {
+		setsockopt(udev_monitor_get_fd(mon), SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	}
+
+	udev_monitor_enable_receiving(mon);
+
+	pollFd = epoll_create1(EPOLL_CLOEXEC);
+	interruptFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (pollFd < 0 || interruptFd < 0 || !AddToPoll(interruptFd, Wake_Interrupt) || !AddToPoll(udev_monitor_get_fd(mon), Wake_Monitor)) {
+		printf("Can't poll the udev monitor\n");
+		return false;
+	}
+
+	return true;
+}
+
+bool UdevEventSource::AddToPoll(int fd, WakeReason_t reason) {
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u32 = reason;
+
+	return epoll_ctl(pollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+bool UdevEventSource::WaitForMonitor() {
+	struct epoll_event events[POLL_MAX_EVENTS];
+
+	for (;;) {
+		int count = epoll_wait(pollFd, events, POLL_MAX_EVENTS, -1);
+		if (count < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+
+		bool isReadable = false;
+		for (int i = 0; i < count; i++) {
+			// The eventfd is never read, so it stays ready and every
+			// later wait returns at once too
+			if (events[i].data.u32 == Wake_Interrupt) {
+				return false;
+			}
+			if (events[i].data.u32 == Wake_Monitor) {
+				isReadable = true;
+			}
+		}
+
+		if (isReadable) {
+			return true;
+		}
+	}
+}
+
+void UdevEventSource::Enumerate(vector<DeviceSourceEvent_t>* devices) {
+	struct udev_enumerate *enumerate;
+	struct udev_list_entry *list, *dev_list_entry;
+	vector<SnapshotEntry_t> entries;
+
+	/* Create a list of the USB devices only, so udev filters out the
+	   rest of sysfs (interfaces, hubs' ports, every other subsystem)
+	   before we ever open it */
+	enumerate = udev_enumerate_new(udev);
+	udev_enumerate_add_match_subsystem(enumerate, DEVICE_SUBSYSTEM);
+	udev_enumerate_add_match_property(enumerate, DEVICE_PROPERTY_DEVTYPE, DEVICE_TYPE_DEVICE);
+	udev_enumerate_scan_devices(enumerate);
+	list = udev_enumerate_get_list_entry(enumerate);
+	/* udev_list_entry_foreach is a macro which expands to
+	   a loop. The loop will be executed for each member in
+	   devices, setting dev_list_entry to a list entry
+	   which contains the device's path in /sys. */
+	udev_list_entry_foreach(dev_list_entry, list) {
+		SnapshotEntry_t entry;
+		entry.syspath = udev_list_entry_get_name(dev_list_entry);
+		entries.push_back(entry);
+	}
+	/* Free the enumerator object */
+	udev_enumerate_unref(enumerate);
+
+	// With a snapshot file, only devices that were plugged in (or moved)
+	// since it was written are read. Each one costs a stat of its /sys
+	// entry, which is taken before reading so a device replaced in the
+	// meantime is stored under the stale stamp and read again next time.
+	const char* snapshotPath = getenv(SNAPSHOT_FILE_ENV);
+	RegistrySnapshot snapshot;
+	bool hasSnapshot = snapshotPath && *snapshotPath && snapshot.Open(snapshotPath);
+
+	vector<size_t> unread;
+	for (size_t i = 0; i < entries.size(); i++) {
+		SnapshotEntry_t& entry = entries[i];
+		bool hasStamp = GetSysfsStamp(entry.syspath.c_str(), &entry.stamp);
+		if (!hasStamp || !hasSnapshot || !snapshot.Find(entry.syspath, entry.stamp, &entry.device)) {
+			unread.push_back(i);
+		}
+	}
+
+	// Every attribute is a sysfs read, so spread the devices over a few
+	// threads. A udev context must not be shared between threads, so
+	// each worker opens its own.
+	size_t workerCount = thread::hardware_concurrency();
+	workerCount = min(workerCount, (size_t) ENUMERATE_MAX_THREADS);
+	workerCount = min(workerCount, unread.size() / ENUMERATE_DEVICES_PER_THREAD + 1);
+	workerCount = max(workerCount, (size_t) 1);
+
+	vector<thread> workers;
+
+	for (size_t i = 1; i < workerCount; i++) {
+		workers.push_back(thread(ReadDevices, &entries, &unread, i, workerCount));
+	}
+	ReadDevices(&entries, &unread, 0, workerCount);
+
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (!entries[i].device.key.empty()) {
+			devices->push_back(entries[i].device);
+		}
+	}
+
+	// Rewritten whenever it no longer matches: a device was read afresh
+	// or one in the snapshot has gone. Entries without a devnode are never
+	// stored, so they are read every time without forcing a rewrite.
+	size_t read = 0;
+	for (size_t i = 0; i < unread.size(); i++) {
+		read += entries[unread[i]].device.key.empty() ? 0 : 1;
+	}
+	if (snapshotPath && *snapshotPath && (!hasSnapshot || read > 0 || snapshot.Size() != devices->size())) {
+		RegistrySnapshot::Write(snapshotPath, entries);
+	}
+}
+
+bool UdevEventSource::Receive(DeviceSourceEvent_t* event) {
+	struct udev_device *dev;
+
+	while (!interrupted) {
+		/* The socket doesn't block: this either returns what is queued
+		   or fails with EAGAIN, and then we wait for more. */
+		errno = 0;
+		dev = udev_monitor_receive_device(mon);
+		if (!dev) {
+			/* The kernel dropped uevents because the socket was full. What
+			   is still queued predates the rescan that follows, so it is
+			   thrown away rather than replayed on top of it. */
+			if (errno == ENOBUFS) {
+				Drain();
+				*event = DeviceSourceEvent_t();
+				event->isOverflow = true;
+				return true;
+			}
+			// Usually EAGAIN. If libudev only skipped a message the socket
+			// is still readable and the wait returns straight away.
+			if (!WaitForMonitor()) {
+				return false;
+			}
+			continue;
+		}
+
+		// The socket filter matches on hashes, so still check the real thing
+		bool isUsbDevice = udev_device_get_devtype(dev) && strcmp(udev_device_get_devtype(dev), DEVICE_TYPE_DEVICE) == 0;
+		const char* action = udev_device_get_action(dev);
+
+		if(isUsbDevice && udev_device_get_devnode(dev) != NULL && (strcmp(action, DEVICE_ACTION_ADDED) == 0 || strcmp(action, DEVICE_ACTION_REMOVED) == 0)) {
+			event->isOverflow = false;
+			event->isAdded = strcmp(action, DEVICE_ACTION_ADDED) == 0;
+			event->key = udev_device_get_devnode(dev);
+			event->device = ListResultItem_t();
+			ReadDeviceFields(dev, &event->device);
+			// udev only keeps a timestamp for devices it has set up, and
+			// taking it is the last thing it does before broadcasting
+			event->systemDelay = event->isAdded ? udev_device_get_usec_since_initialized(dev) : 0;
+
+			udev_device_unref(dev);
+			return true;
+		}
+
+		udev_device_unref(dev);
+	}
+
+	return false;
+}
+
+void UdevEventSource::Drain() {
+	struct udev_device *dev;
+
+	// The socket doesn't block, so this stops at EAGAIN once it is empty.
+	// A NULL without an error is just a message libudev skipped.
+	for (;;) {
+		errno = 0;
+		dev = udev_monitor_receive_device(mon);
+		if (dev) {
+			udev_device_unref(dev);
+		}
+		else if (interrupted || (errno != 0 && errno != EINTR && errno != ENOBUFS)) {
+			return;
+		}
+	}
+}
+
+void UdevEventSource::Interrupt() {
+	interrupted = true;
+
+	// Only a write, so this is safe from any thread
+	uint64_t value = 1;
+	if (interruptFd >= 0 && write(interruptFd, &value, sizeof(value)) < 0) {
+		printf("Can't wake the udev monitor\n");
+	}
+}
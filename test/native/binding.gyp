@@ -0,0 +1,153 @@
+{
+  "targets": [
+    {
+      "target_name": "event_debounce",
+      "type": "executable",
+      "sources": [
+        "event_debounce.cpp",
+        "../../src/deviceList.cpp",
+        "../../src/eventDebouncer.cpp",
+        "../../src/internedString.cpp"
+      ],
+      "include_dirs": [
+        "../../src"
+      ],
+      "conditions": [
+        ['OS!="win"',
+          {
+            "libraries": [
+              "-lpthread"
+            ]
+          }
+        ]
+      ]
+    },
+    {
+      "target_name": "event_queue_burst",
+      "type": "executable",
+      "sources": [
+        "event_queue_burst.cpp",
+        "../../src/eventQueue.cpp",
+        "../../src/internedString.cpp"
+      ],
+      "include_dirs": [
+        "../../src"
+      ],
+      "conditions": [
+        ['OS!="win"',
+          {
+            "libraries": [
+              "-lpthread"
+            ]
+          }
+        ]
+      ]
+    },
+    {
+      "target_name": "latency_histogram",
+      "type": "executable",
+      "sources": [
+        "latency_histogram.cpp",
+        "../../src/detectionStats.cpp"
+      ],
+      "include_dirs": [
+        "../../src"
+      ],
+      "conditions": [
+        ['OS!="win"',
+          {
+            "libraries": [
+              "-lpthread"
+            ]
+          }
+        ]
+      ]
+    },
+    {
+      "target_name": "registry_snapshot",
+      "type": "executable",
+      "sources": [
+        "registry_snapshot.cpp",
+        "../../src/internedString.cpp",
+        "../../src/registrySnapshot.cpp"
+      ],
+      "include_dirs": [
+        "../../src"
+      ],
+      "conditions": [
+        ['OS!="win"',
+          {
+            "libraries": [
+              "-lpthread"
+            ]
+          }
+        ]
+      ]
+    },
+    {
+      "target_name": "registry_stress",
+      "type": "executable",
+      "sources": [
+        "registry_stress.cpp",
+        "../../src/deviceList.cpp",
+        "../../src/internedString.cpp"
+      ],
+      "include_dirs": [
+        "../../src"
+      ],
+      "conditions": [
+        ['OS!="win"',
+          {
+            "libraries": [
+              "-lpthread"
+            ]
+          }
+        ]
+      ]
+    },
+    {
+      "target_name": "shared_registry",
+      "type": "executable",
+      "sources": [
+        "shared_registry.cpp",
+        "../../src/internedString.cpp",
+        "../../src/sharedRegistry.cpp"
+      ],
+      "include_dirs": [
+        "../../src"
+      ],
+      "conditions": [
+        ['OS=="linux"',
+          {
+            "libraries": [
+              "-lpthread",
+              "-lrt"
+            ]
+          }
+        ]
+      ]
+    },
+    {
+      "target_name": "subscription_routing",
+      "type": "executable",
+      "sources": [
+        "subscription_routing.cpp",
+        "../../src/deviceList.cpp",
+        "../../src/internedString.cpp",
+        "../../src/subscriptionTable.cpp"
+      ],
+      "include_dirs": [
+        "../../src"
+      ],
+      "conditions": [
+        ['OS!="win"',
+          {
+            "libraries": [
+              "-lpthread"
+            ]
+          }
+        ]
+      ]
+    }
+  ]
+}
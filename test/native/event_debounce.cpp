@@ -0,0 +1,96 @@
+// Feeds a device flapping in and out, a device that really was plugged in,
+// one that was unplugged and plugged back and identical devices in
+// different ports through the debouncer, and checks only the net changes
+// come out once their windows close.
+
+#include <vector>
+#include <stdio.h>
+
+#include "eventDebouncer.h"
+
+#define WINDOW 50
+#define FLAPS 40
+
+int errors = 0;
+
+DeviceEvent_t CreateEvent(int vid, int pid, const char* serial, bool isAdded, const char* portPath = "") {
+	ListResultItem_t item = ListResultItem_t();
+	item.vendorId = vid;
+	item.productId = pid;
+	item.serialNumber = serial;
+	item.portPath = portPath;
+
+	DeviceEvent_t event;
+	event.record = CreateRecord(item);
+	event.isAdded = isAdded;
+
+	return event;
+}
+
+void Expect(bool condition, const char* what) {
+	if (!condition) {
+		printf("%s\n", what);
+		errors++;
+	}
+}
+
+int main() {
+	EventDebouncer debouncer;
+	std::vector<DeviceEvent_t> ready;
+
+	debouncer.SetWindow(WINDOW);
+
+	// Flaps an odd number of times, so it ends up added
+	for (int i = 0; i < FLAPS + 1; i++) {
+		debouncer.Add(CreateEvent(0x16c0, 0x0483, "A1", i % 2 == 0), i);
+	}
+	// Same vendor and product, told apart by serial number
+	debouncer.Add(CreateEvent(0x16c0, 0x0483, "B2", true), 10);
+	// Unplugged and plugged back, so nothing changed
+	debouncer.Add(CreateEvent(0x0781, 0x5567, "", false), 20);
+	debouncer.Add(CreateEvent(0x0781, 0x5567, "", true), 30);
+
+	debouncer.Flush(WINDOW - 1, &ready);
+	Expect(ready.empty(), "delivered a change before its window closed");
+	Expect(debouncer.NextDeadline() == WINDOW, "first window closes at the wrong time");
+
+	debouncer.Flush(WINDOW, &ready);
+	Expect(ready.size() == 1 && ready[0].isAdded && ready[0].record->serialNumber == InternedString("A1"), "flapping device didn't come out as one add");
+	ready.clear();
+
+	debouncer.Flush(WINDOW + 30, &ready);
+	Expect(ready.size() == 1 && ready[0].isAdded && ready[0].record->serialNumber == InternedString("B2"), "second device was collapsed with the first");
+	ready.clear();
+	Expect(!debouncer.HasPending(), "windows left open after they all closed");
+
+	Expect(debouncer.SuppressedCount() == FLAPS + 2, "wrong number of suppressed events");
+
+	// A change after the window closed opens a new one
+	debouncer.Add(CreateEvent(0x16c0, 0x0483, "A1", false), 100);
+	debouncer.Flush(100 + WINDOW, &ready);
+	Expect(ready.size() == 1 && !ready[0].isAdded, "change after the window was lost");
+	ready.clear();
+
+	debouncer.Add(CreateEvent(0x16c0, 0x0483, "A1", true), 200);
+	debouncer.Clear();
+	debouncer.Flush(200 + WINDOW, &ready);
+	Expect(ready.empty(), "cleared window was still delivered");
+
+	// Two identical devices without a serial number, told apart by port
+	debouncer.Add(CreateEvent(0x0403, 0x6001, "", true, "1-1"), 300);
+	debouncer.Add(CreateEvent(0x0403, 0x6001, "", true, "1-2"), 301);
+	debouncer.Flush(300 + WINDOW + 1, &ready);
+	Expect(ready.size() == 2 && ready[0].isAdded && ready[1].isAdded && !(ready[0].record->portPath == ready[1].record->portPath), "identical devices in different ports were collapsed");
+	ready.clear();
+
+	// One unplugged while the other is plugged in doesn't cancel out
+	debouncer.Add(CreateEvent(0x0403, 0x6001, "", false, "1-1"), 400);
+	debouncer.Add(CreateEvent(0x0403, 0x6001, "", true, "1-3"), 401);
+	debouncer.Flush(400 + WINDOW + 1, &ready);
+	Expect(ready.size() == 2 && !ready[0].isAdded && ready[1].isAdded, "removing one identical device cancelled adding another");
+	ready.clear();
+
+	printf("%lu events suppressed, %d debounce errors\n", debouncer.SuppressedCount(), errors);
+
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+// Pushes synthetic bursts of add/remove events through the event queue
+// from a producer thread and checks that every one of them reaches the
+// consumer, in order. A burst smaller than the ring must go through
+// without the producer ever finding it full. A burst several times its
+// size, with the consumer holding off until the ring has filled, must
+// still lose nothing once the producer resumes.
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <stdio.h>
+
+#include "eventQueue.h"
+
+#define BURST_SIZE 10000
+#define BACKPRESSURE_BURST_SIZE (EVENT_QUEUE_DEFAULT_CAPACITY * 3 + 1000)
+
+typedef struct {
+	int received;
+	int outOfOrder;
+	size_t fullCount;
+	bool isEmpty;
+} BurstResult_t;
+
+BurstResult_t RunBurst(int size, bool stallConsumer) {
+	DeviceEventQueue queue;
+	std::atomic<size_t> fullCount(0);
+
+	std::thread producer([&queue, &fullCount, size]() {
+		for(int i = 0; i < size; i++) {
+			std::shared_ptr<ListResultItem_t> record = std::make_shared<ListResultItem_t>();
+			record->locationId = i;
+
+			DeviceEvent_t event;
+			event.record = record;
+			event.isAdded = (i % 2) == 0;
+
+			while(!queue.Push(event)) {
+				fullCount++;
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	// Hold off until the ring has filled up
+	while(stallConsumer && fullCount == 0) {
+		std::this_thread::yield();
+	}
+
+	BurstResult_t result = { 0, 0, 0, false };
+	DeviceEvent_t events[64];
+	while(result.received < size) {
+		size_t count = queue.Pop(events, 64);
+		for(size_t i = 0; i < count; i++, result.received++) {
+			if(events[i].record->locationId != result.received || events[i].isAdded != ((result.received % 2) == 0)) {
+				result.outOfOrder++;
+			}
+			events[i].record.reset();
+		}
+	}
+
+	producer.join();
+
+	result.fullCount = fullCount;
+	result.isEmpty = queue.IsEmpty();
+
+	return result;
+}
+
+int main() {
+	BurstResult_t burst = RunBurst(BURST_SIZE, false);
+	printf("received %d/%d events, %d out of order, producer blocked %zu times\n", burst.received, BURST_SIZE, burst.outOfOrder, burst.fullCount);
+
+	BurstResult_t backpressure = RunBurst(BACKPRESSURE_BURST_SIZE, true);
+	printf("with the consumer stalled: received %d/%d events, %d out of order, producer blocked %zu times\n", backpressure.received, BACKPRESSURE_BURST_SIZE, backpressure.outOfOrder, backpressure.fullCount);
+
+	bool isBurstOk = burst.received == BURST_SIZE && burst.outOfOrder == 0 && burst.fullCount == 0 && burst.isEmpty;
+	bool isBackpressureOk = backpressure.received == BACKPRESSURE_BURST_SIZE && backpressure.outOfOrder == 0 && backpressure.fullCount > 0 && backpressure.isEmpty;
+
+	return (isBurstOk && isBackpressureOk) ? 0 : 1;
+}
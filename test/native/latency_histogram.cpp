@@ -0,0 +1,71 @@
+// Records a known distribution into the latency histogram from several
+// threads at once and checks the counts add up and every percentile lands
+// within the histogram's precision of the exact value.
+
+#include <math.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "detectionStats.h"
+
+#define THREAD_COUNT 4
+#define VALUES_PER_THREAD 250000
+
+int errors = 0;
+
+void ExpectNear(const char* name, uint64_t actual, uint64_t expected) {
+	// Buckets are an eighth of a power of two wide
+	if (fabs((double) actual - (double) expected) > expected / 8.0 + 1) {
+		printf("%s is %llu, expected about %llu\n", name, (unsigned long long) actual, (unsigned long long) expected);
+		errors++;
+	}
+}
+
+int main() {
+	// Every value falls in a bucket whose bounds contain it
+	for (uint64_t value = 0; value < (1 << 20); value++) {
+		int index = LatencyHistogram::GetBucketIndex(value);
+		if (value > LatencyHistogram::GetBucketUpperBound(index) || (index > 0 && value <= LatencyHistogram::GetBucketUpperBound(index - 1))) {
+			printf("%llu is outside bucket %d\n", (unsigned long long) value, index);
+			errors++;
+			break;
+		}
+	}
+	if (LatencyHistogram::GetBucketIndex(UINT64_MAX) != LATENCY_BUCKET_COUNT - 1) {
+		printf("largest value doesn't land in the last bucket\n");
+		errors++;
+	}
+
+	// Each thread records 1..VALUES_PER_THREAD once, so the percentiles
+	// are the same as for one pass
+	LatencyHistogram histogram;
+	std::vector<std::thread> threads;
+	for (int i = 0; i < THREAD_COUNT; i++) {
+		threads.push_back(std::thread([&histogram]() {
+			for (uint64_t value = 1; value <= VALUES_PER_THREAD; value++) {
+				histogram.Record(value);
+			}
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+
+	LatencySummary_t summary;
+	histogram.Summarize(&summary);
+
+	if (summary.count != THREAD_COUNT * VALUES_PER_THREAD || summary.min != 1 || summary.max != VALUES_PER_THREAD) {
+		printf("count %llu, min %llu, max %llu\n", (unsigned long long) summary.count, (unsigned long long) summary.min, (unsigned long long) summary.max);
+		errors++;
+	}
+	ExpectNear("mean", (uint64_t) summary.mean, VALUES_PER_THREAD / 2);
+	ExpectNear("p50", summary.p50, VALUES_PER_THREAD / 2);
+	ExpectNear("p90", summary.p90, VALUES_PER_THREAD * 9 / 10);
+	ExpectNear("p99", summary.p99, VALUES_PER_THREAD * 99 / 100);
+	ExpectNear("p999", summary.p999, VALUES_PER_THREAD * 999 / 1000);
+
+	printf("%llu values, p50 %llu, p99 %llu, %d histogram errors\n", (unsigned long long) summary.count, (unsigned long long) summary.p50, (unsigned long long) summary.p99, errors);
+
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+// Writes a snapshot of real directories, then checks every entry is found
+// again while its directory is unchanged, is missed once the directory is
+// recreated, and that damaged files are ignored rather than read.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "registrySnapshot.h"
+
+#define DEVICE_COUNT 200
+
+int errors = 0;
+
+void Expect(bool condition, const char* message) {
+	if (!condition) {
+		printf("%s\n", message);
+		errors++;
+	}
+}
+
+SnapshotEntry_t CreateEntry(const std::string& syspath, int i) {
+	SnapshotEntry_t entry;
+	entry.syspath = syspath;
+	GetSysfsStamp(syspath.c_str(), &entry.stamp);
+
+	char devnode[32];
+	snprintf(devnode, sizeof(devnode), "/dev/bus/usb/001/%03d", i);
+	entry.device.key = devnode;
+	entry.device.device = ListResultItem_t();
+	entry.device.device.vendorId = 0x1000 + i;
+	entry.device.device.productId = i;
+	entry.device.device.deviceAddress = i;
+	entry.device.device.busNumber = 1;
+	entry.device.device.portPath = std::to_string(i);
+	// Every other device has no serial, so empty strings get covered too
+	if (i % 2 == 0) {
+		entry.device.device.serialNumber = "SN" + std::to_string(i);
+	}
+
+	return entry;
+}
+
+int main() {
+	char root[] = "/tmp/usb-detection-snapshot-XXXXXX";
+	if (mkdtemp(root) == NULL) {
+		printf("can't create a temporary directory\n");
+		return 1;
+	}
+	std::string file = std::string(root) + "/registry";
+
+	std::vector<SnapshotEntry_t> entries;
+	for (int i = 0; i < DEVICE_COUNT; i++) {
+		std::string syspath = std::string(root) + "/" + std::to_string(i);
+		mkdir(syspath.c_str(), 0700);
+		entries.push_back(CreateEntry(syspath, i));
+	}
+	// Not a device: left out of the file
+	SnapshotEntry_t skipped;
+	skipped.syspath = root;
+	entries.push_back(skipped);
+
+	Expect(RegistrySnapshot::Write(file, entries), "write failed");
+
+	RegistrySnapshot snapshot;
+	Expect(snapshot.Open(file), "can't open what was written");
+	Expect(snapshot.Size() == DEVICE_COUNT, "wrong number of records");
+
+	size_t found = 0;
+	for (int i = 0; i < DEVICE_COUNT; i++) {
+		SysfsStamp_t stamp;
+		DeviceSourceEvent_t device;
+		GetSysfsStamp(entries[i].syspath.c_str(), &stamp);
+		if (!snapshot.Find(entries[i].syspath, stamp, &device)) {
+			continue;
+		}
+		found++;
+
+		const ListResultItem_t& expected = entries[i].device.device;
+		if (device.key != entries[i].device.key || device.device.vendorId != expected.vendorId
+			|| device.device.deviceAddress != expected.deviceAddress || !(device.device.serialNumber == expected.serialNumber)
+			|| !(device.device.portPath == expected.portPath) || !device.isAdded) {
+			printf("%s came back different\n", entries[i].syspath.c_str());
+			errors++;
+		}
+	}
+	Expect(found == DEVICE_COUNT, "unchanged devices were missed");
+
+	// Plugged back in: a new directory in the same place. It is made
+	// before the old one goes so the filesystem can't hand out the same
+	// inode, which sysfs never does this quickly either.
+	std::string replacement = std::string(root) + "/replacement";
+	mkdir(replacement.c_str(), 0700);
+	rmdir(entries[0].syspath.c_str());
+	rename(replacement.c_str(), entries[0].syspath.c_str());
+	SysfsStamp_t stamp;
+	DeviceSourceEvent_t device;
+	GetSysfsStamp(entries[0].syspath.c_str(), &stamp);
+	Expect(!snapshot.Find(entries[0].syspath, stamp, &device), "a recreated device was found");
+	Expect(!snapshot.Find(std::string(root) + "/missing", stamp, &device), "a missing device was found");
+
+	// Cut short, as if the disk filled up during a write
+	std::string truncated = std::string(root) + "/truncated";
+	std::vector<SnapshotEntry_t> one(entries.begin(), entries.begin() + 1);
+	RegistrySnapshot::Write(truncated, one);
+	struct stat info;
+	stat(truncated.c_str(), &info);
+	Expect(truncate(truncated.c_str(), info.st_size - 1) == 0, "can't truncate");
+	RegistrySnapshot damaged;
+	Expect(!damaged.Open(truncated), "a truncated file was opened");
+	Expect(!damaged.Open(entries[1].syspath), "a directory was opened");
+
+	unlink(truncated.c_str());
+	unlink(file.c_str());
+	for (int i = 0; i < DEVICE_COUNT; i++) {
+		rmdir(entries[i].syspath.c_str());
+	}
+	rmdir(root);
+
+	printf("%d devices, %zu found unchanged, %d snapshot errors\n", DEVICE_COUNT, found, errors);
+
+	return errors == 0 ? 0 : 1;
+}
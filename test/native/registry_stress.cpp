@@ -0,0 +1,148 @@
+// Runs find()-style reads in a loop on several threads while a writer
+// thread plays a synthetic hotplug storm against the device list, and
+// checks that every snapshot the readers see is internally consistent.
+// A follower keeps a device count up to date from the change journal alone,
+// and another the set of devices from the differences between snapshots;
+// both must end up agreeing with the final snapshot.
+
+#include <atomic>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+
+#include "deviceList.h"
+
+#define STORM_OPERATIONS 200000
+#define STORM_KEYS 1024
+#define STORM_VENDORS 8
+#define READER_THREADS 3
+
+int main() {
+	std::atomic<bool> stormDone(false);
+	std::atomic<int> errors(0);
+	std::atomic<long> finds(0);
+	std::atomic<long> resyncs(0);
+
+	std::thread writer([&stormDone]() {
+		char key[32];
+		for(int i = 0; i < STORM_OPERATIONS; i++) {
+			int id = (i * 7919) % STORM_KEYS;
+			snprintf(key, sizeof(key), "/dev/bus/usb/%d", id);
+
+			if(IsItemAlreadyStored(key)) {
+				DeviceItem_t* item = GetItemFromList(key);
+				RemoveItemFromList(item);
+				delete item;
+			}
+			else {
+				DeviceItem_t* item = new DeviceItem_t();
+				item->deviceParams.vendorId = (id % STORM_VENDORS) + 1;
+				item->deviceParams.productId = id;
+				item->deviceParams.deviceName = key;
+				AddItemToList(key, item);
+			}
+		}
+		stormDone = true;
+	});
+
+	std::vector<std::thread> readers;
+	for(int r = 0; r < READER_THREADS; r++) {
+		readers.push_back(std::thread([r, &stormDone, &errors, &finds]() {
+			while(!stormDone) {
+				// Reader 0 lists everything, 1 filters by vendor, 2 by vendor and product
+				int id = (int) (finds % STORM_KEYS);
+				int vid = (r == 0) ? 0 : (id % STORM_VENDORS) + 1;
+				int pid = (r == 2) ? id : 0;
+				std::vector<ListResultItem_t> results;
+				CreateFilteredList(&results, vid, pid);
+
+				for(size_t i = 0; i < results.size(); i++) {
+					if((vid != 0 && results[i].vendorId != vid) || (pid != 0 && results[i].productId != pid) || strncmp(results[i].deviceName.c_str(), "/dev/bus/usb/", 13) != 0) {
+						errors++;
+					}
+				}
+
+				std::shared_ptr<const DeviceSnapshot_t> snapshot = GetDeviceSnapshot();
+				size_t size = 0;
+				for(int i = 0; i < DEVICE_LIST_SHARD_COUNT; i++) {
+					size += snapshot->shards[i] ? snapshot->shards[i]->devices.size() : 0;
+				}
+				if(size != snapshot->size || size > STORM_KEYS) {
+					errors++;
+				}
+
+				finds++;
+			}
+		}));
+	}
+
+	// Mirrors the list size through GetChangesSince, falling back to the
+	// snapshot whenever it drops far enough behind for the journal to wrap
+	long followed = 0;
+	unsigned long generation = 0;
+	auto follow = [&followed, &generation, &errors, &resyncs]() {
+		DeviceChangeSet_t changeSet;
+		GetChangesSince(generation, &changeSet);
+
+		if(changeSet.resyncRequired) {
+			followed = (long) changeSet.snapshot->size;
+			if(changeSet.snapshot->version != changeSet.generation) {
+				errors++;
+			}
+			resyncs++;
+		}
+
+		for(size_t i = 0; i < changeSet.changes.size(); i++) {
+			if(changeSet.changes[i].generation != generation + i + 1) {
+				errors++;
+			}
+			followed += changeSet.changes[i].isAdded ? 1 : -1;
+		}
+		generation = changeSet.generation;
+	};
+
+	// Mirrors the keys by applying the differences between whichever
+	// snapshots it happens to load
+	std::set<std::string> mirrored;
+	// The storm is already under way, so start from an empty list
+	std::shared_ptr<const DeviceSnapshot_t> mirroredSnapshot = std::make_shared<DeviceSnapshot_t>();
+	auto mirror = [&mirrored, &mirroredSnapshot, &errors]() {
+		std::shared_ptr<const DeviceSnapshot_t> current = GetDeviceSnapshot();
+		std::vector<DeviceChange_t> changes;
+		GetChangesBetween(mirroredSnapshot.get(), current.get(), &changes);
+
+		for(size_t i = 0; i < changes.size(); i++) {
+			std::string key = changes[i].record->deviceName.c_str();
+			// Every removal is of a device it has, every addition of one it hasn't
+			if((changes[i].isAdded ? mirrored.insert(key).second : mirrored.erase(key) == 1) == false) {
+				errors++;
+			}
+		}
+		mirroredSnapshot = current;
+	};
+
+	std::thread follower([&stormDone, &follow, &mirror]() {
+		while(!stormDone) {
+			follow();
+			mirror();
+		}
+	});
+
+	writer.join();
+	follower.join();
+	follow();
+	mirror();
+	if(followed != (long) GetDeviceSnapshot()->size || mirrored.size() != GetDeviceSnapshot()->size) {
+		errors++;
+	}
+
+	for(size_t r = 0; r < readers.size(); r++) {
+		readers[r].join();
+	}
+
+	printf("%d hotplug operations, %ld concurrent finds, %ld journal resyncs, %d inconsistencies\n", STORM_OPERATIONS, finds.load(), resyncs.load(), errors.load());
+
+	return errors == 0 ? 0 : 1;
+}
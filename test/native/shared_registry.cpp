@@ -0,0 +1,322 @@
+// Runs an owner and a reader of one shared registry segment against a
+// scripted monitor. The reader has to end up with exactly the devices the
+// owner saw: after a steady stream of changes, after falling a whole ring
+// behind, after taking over from an owner that died mid-update (once a
+// process that couldn't has let go), and with more devices than the table
+// holds.
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+#include "sharedRegistry.h"
+
+#define INITIAL_DEVICES 20
+#define CHANGE_COUNT 5000
+#define KEY_RANGE 200
+#define SETTLE_TIMEOUT_MS 5000
+
+// What is plugged in, and the monitors that currently hear about it
+std::mutex hardwareMutex;
+std::map<std::string, DeviceSourceEvent_t> hardware;
+std::set<class ScriptedSource*> scripted;
+
+class ScriptedSource : public DeviceEventSource {
+	public:
+		ScriptedSource() : interrupted(false) {}
+
+		~ScriptedSource() {
+			std::lock_guard<std::mutex> lock(hardwareMutex);
+			scripted.erase(this);
+		}
+
+		bool Open() {
+			return true;
+		}
+
+		void Enumerate(std::vector<DeviceSourceEvent_t>* devices) {
+			std::lock_guard<std::mutex> lock(hardwareMutex);
+			for (std::map<std::string, DeviceSourceEvent_t>::iterator it = hardware.begin(); it != hardware.end(); ++it) {
+				devices->push_back(it->second);
+			}
+		}
+
+		bool Receive(DeviceSourceEvent_t* event) {
+			std::unique_lock<std::mutex> lock(pendingMutex);
+			pendingCondition.wait(lock, [this]() { return interrupted || !pending.empty(); });
+			if (interrupted) {
+				return false;
+			}
+
+			*event = pending.front();
+			pending.pop_front();
+			return true;
+		}
+
+		void Interrupt() {
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			interrupted = true;
+			pendingCondition.notify_all();
+		}
+
+		void Push(const DeviceSourceEvent_t& event) {
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			pending.push_back(event);
+			pendingCondition.notify_all();
+		}
+
+	private:
+		std::mutex pendingMutex;
+		std::condition_variable pendingCondition;
+		std::deque<DeviceSourceEvent_t> pending;
+		bool interrupted;
+};
+
+// A monitor that can't start, as when udev isn't available
+class FailingSource : public ScriptedSource {
+	public:
+		bool Open() {
+			return false;
+		}
+};
+
+DeviceEventSource* CreateFailingSource() {
+	return new FailingSource();
+}
+
+DeviceEventSource* CreateScriptedSource() {
+	std::lock_guard<std::mutex> lock(hardwareMutex);
+	ScriptedSource* created = new ScriptedSource();
+	scripted.insert(created);
+	return created;
+}
+
+void Change(int id, bool isAdded) {
+	DeviceSourceEvent_t event;
+	event.isOverflow = false;
+	event.isAdded = isAdded;
+	event.key = "/dev/bus/usb/001/" + std::to_string(id);
+	event.device = ListResultItem_t();
+	event.device.vendorId = id;
+	event.device.productId = rand() % 1000;
+	event.device.serialNumber = std::to_string(event.device.productId);
+	event.systemDelay = 0;
+
+	std::lock_guard<std::mutex> lock(hardwareMutex);
+	// The kernel never reports the same change twice in a row
+	if (isAdded == (hardware.count(event.key) > 0)) {
+		return;
+	}
+	if (isAdded) {
+		hardware[event.key] = event;
+	}
+	else {
+		hardware.erase(event.key);
+	}
+	for (std::set<ScriptedSource*>::iterator it = scripted.begin(); it != scripted.end(); ++it) {
+		(*it)->Push(event);
+	}
+}
+
+// Mirrors what the monitor thread does with a source
+struct Consumer {
+	SharedRegistrySource* source;
+	std::mutex devicesMutex;
+	std::map<std::string, DeviceSourceEvent_t> devices;
+	std::atomic<bool> paused;
+	std::atomic<int> overflows;
+
+	Consumer(SharedRegistrySource* source) : source(source), paused(false), overflows(0) {}
+
+	void Enumerate() {
+		std::vector<DeviceSourceEvent_t> enumerated;
+		source->Enumerate(&enumerated);
+
+		std::lock_guard<std::mutex> lock(devicesMutex);
+		devices.clear();
+		for (size_t i = 0; i < enumerated.size(); i++) {
+			devices[enumerated[i].key] = enumerated[i];
+		}
+	}
+
+	void Run() {
+		Enumerate();
+
+		DeviceSourceEvent_t event;
+		while (source->Receive(&event)) {
+			while (paused) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+
+			if (event.isOverflow) {
+				overflows++;
+				Enumerate();
+				continue;
+			}
+
+			std::lock_guard<std::mutex> lock(devicesMutex);
+			if (event.isAdded) {
+				devices[event.key] = event;
+			}
+			else {
+				devices.erase(event.key);
+			}
+		}
+	}
+
+	bool Matches() {
+		std::lock_guard<std::mutex> hardwareLock(hardwareMutex);
+		std::lock_guard<std::mutex> lock(devicesMutex);
+		if (devices.size() != hardware.size()) {
+			return false;
+		}
+		for (std::map<std::string, DeviceSourceEvent_t>::iterator it = hardware.begin(); it != hardware.end(); ++it) {
+			std::map<std::string, DeviceSourceEvent_t>::iterator found = devices.find(it->first);
+			if (found == devices.end() || found->second.device.productId != it->second.device.productId || !(found->second.device.serialNumber == it->second.device.serialNumber)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool Settle() {
+		for (int waited = 0; waited < SETTLE_TIMEOUT_MS; waited++) {
+			if (Matches()) {
+				return true;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return false;
+	}
+};
+
+int errors = 0;
+
+void Expect(bool condition, const char* message) {
+	if (!condition) {
+		printf("%s\n", message);
+		errors++;
+	}
+}
+
+int main() {
+	std::string name = "/usb-detection-test-" + std::to_string(getpid());
+	shm_unlink(name.c_str());
+
+	for (int i = 0; i < INITIAL_DEVICES; i++) {
+		Change(i, true);
+	}
+
+	SharedRegistrySource* owner = new SharedRegistrySource(name, CreateScriptedSource);
+	Expect(owner->Open() && owner->IsOwner(), "first source isn't the owner");
+	Consumer ownerConsumer(owner);
+	std::thread ownerThread(&Consumer::Run, &ownerConsumer);
+
+	SharedRegistrySource* reader = new SharedRegistrySource(name, CreateScriptedSource);
+	Expect(reader->Open() && !reader->IsOwner(), "second source isn't a reader");
+	Consumer readerConsumer(reader);
+	std::thread readerThread(&Consumer::Run, &readerConsumer);
+
+	Expect(readerConsumer.Settle(), "reader doesn't see the initial devices");
+
+	for (int i = 0; i < CHANGE_COUNT; i++) {
+		Change(rand() % KEY_RANGE, rand() % 2 == 0);
+	}
+	Expect(readerConsumer.Settle(), "reader is out of step after a stream of changes");
+
+	// Hold the reader back for more than a whole ring
+	readerConsumer.paused = true;
+	int overflows = readerConsumer.overflows;
+	for (int i = 0; i < SHARED_EVENT_CAPACITY * 3; i++) {
+		Change(rand() % KEY_RANGE, rand() % 2 == 0);
+	}
+	Expect(ownerConsumer.Settle(), "owner is out of step");
+	readerConsumer.paused = false;
+	Change(KEY_RANGE, true);
+	Expect(readerConsumer.Settle(), "reader is out of step after being lapped");
+	Expect(readerConsumer.overflows > overflows, "reader wasn't told it was lapped");
+
+	// The owner goes away; changes meanwhile are picked up by the rescan
+	owner->Interrupt();
+	ownerThread.join();
+	delete owner;
+
+	// As if it had died in the middle of publishing a change
+	int fd = shm_open(name.c_str(), O_RDWR, 0600);
+	SharedRegion_t* region = (SharedRegion_t*) mmap(NULL, sizeof(SharedRegion_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	Expect(region != MAP_FAILED, "can't map the segment");
+	region->sequence.fetch_add(1);
+	region->events[region->eventHead & (SHARED_EVENT_CAPACITY - 1)].sequence.store(region->eventHead * 2 + 1);
+	munmap(region, sizeof(SharedRegion_t));
+	close(fd);
+
+	// Gets the lock first but can't start a monitor, so it has to let the
+	// lock go again for the reader
+	SharedRegistrySource* failing = new SharedRegistrySource(name, CreateFailingSource);
+	Expect(!failing->Open(), "failing source opened");
+
+	for (int i = 0; i < 50; i++) {
+		Change(rand() % KEY_RANGE, rand() % 2 == 0);
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	while (!reader->IsOwner() && std::chrono::steady_clock::now() - start < std::chrono::milliseconds(SHARED_OWNER_CHECK_MS * 3)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	Expect(reader->IsOwner(), "reader didn't take over");
+	delete failing;
+	Expect(readerConsumer.Settle(), "reader is out of step after taking over");
+
+	for (int i = 0; i < 100; i++) {
+		Change(rand() % KEY_RANGE, rand() % 2 == 0);
+	}
+	Expect(readerConsumer.Settle(), "new owner is out of step");
+
+	// Only readable if the new owner cleaned up after the old one
+	SharedRegistrySource* late = new SharedRegistrySource(name, CreateScriptedSource);
+	Expect(late->Open() && !late->IsOwner(), "late source isn't a reader");
+	Consumer lateConsumer(late);
+	std::thread lateThread(&Consumer::Run, &lateConsumer);
+	Expect(lateConsumer.Settle(), "late reader is out of step");
+	late->Interrupt();
+	lateThread.join();
+	delete late;
+
+	// More devices than the table holds; a reader has to enumerate them
+	// itself but still follows the ring
+	for (int i = 0; i < SHARED_DEVICE_CAPACITY; i++) {
+		Change(KEY_RANGE + 1 + i, true);
+	}
+	Expect(readerConsumer.Settle(), "owner is out of step with a full table");
+	SharedRegistrySource* crowded = new SharedRegistrySource(name, CreateScriptedSource);
+	Expect(crowded->Open() && !crowded->IsOwner(), "crowded source isn't a reader");
+	Consumer crowdedConsumer(crowded);
+	std::thread crowdedThread(&Consumer::Run, &crowdedConsumer);
+	Expect(crowdedConsumer.Settle(), "reader misses devices that didn't fit the table");
+	for (int i = 0; i < 100; i++) {
+		Change(rand() % (KEY_RANGE + SHARED_DEVICE_CAPACITY), rand() % 2 == 0);
+	}
+	Expect(crowdedConsumer.Settle(), "reader is out of step with a full table");
+	crowded->Interrupt();
+	crowdedThread.join();
+	delete crowded;
+
+	reader->Interrupt();
+	readerThread.join();
+	delete reader;
+	shm_unlink(name.c_str());
+
+	printf("%d changes, %d reader resyncs, %d shared registry errors\n", CHANGE_COUNT + SHARED_EVENT_CAPACITY * 3 + SHARED_DEVICE_CAPACITY + 251, (int) readerConsumer.overflows, errors);
+
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,55 @@
+// Checks that changes are routed to exactly the subscriptions that match
+// them, most specific first, with a few thousand unrelated subscriptions
+// in the table, and that removed subscriptions stop matching.
+
+#include <vector>
+#include <stdio.h>
+
+#include "subscriptionTable.h"
+
+#define UNRELATED_VENDORS 1000
+
+int errors = 0;
+
+void Expect(const SubscriptionTable& table, int vid, int pid, int change, const std::vector<unsigned int>& expected) {
+	std::vector<unsigned int> ids;
+	table.Match(vid, pid, change, &ids);
+
+	if (ids != expected) {
+		printf("change %d for %04x:%04x matched %d subscriptions, expected %d\n", change, vid, pid, (int) ids.size(), (int) expected.size());
+		errors++;
+	}
+}
+
+int main() {
+	SubscriptionTable table;
+
+	for (int i = 0; i < UNRELATED_VENDORS; i++) {
+		table.Add(0x8000 + i, 0, CHANGE_MASK_ADDED | CHANGE_MASK_REMOVED);
+		table.Add(0x8000 + i, 1, CHANGE_MASK_ADDED);
+	}
+
+	unsigned int any = table.Add(0, 0, CHANGE_MASK_ADDED | CHANGE_MASK_REMOVED);
+	unsigned int vendor = table.Add(0x16c0, 0, CHANGE_MASK_ADDED);
+	unsigned int product = table.Add(0x16c0, 0x0483, CHANGE_MASK_ADDED);
+	unsigned int productRemoved = table.Add(0x16c0, 0x0483, CHANGE_MASK_REMOVED);
+
+	Expect(table, 0x16c0, 0x0483, CHANGE_MASK_ADDED, {product, vendor, any});
+	Expect(table, 0x16c0, 0x0483, CHANGE_MASK_REMOVED, {productRemoved, any});
+	Expect(table, 0x16c0, 0x0001, CHANGE_MASK_ADDED, {vendor, any});
+	Expect(table, 0x0781, 0x5567, CHANGE_MASK_REMOVED, {any});
+
+	table.Remove(vendor);
+	table.Remove(any);
+	Expect(table, 0x16c0, 0x0483, CHANGE_MASK_ADDED, {product});
+	Expect(table, 0x0781, 0x5567, CHANGE_MASK_ADDED, {});
+
+	if (table.Remove(any)) {
+		printf("removed subscription %u twice\n", any);
+		errors++;
+	}
+
+	printf("%d subscriptions, %d routing errors\n", UNRELATED_VENDORS * 2 + 2, errors);
+
+	return errors == 0 ? 0 : 1;
+}
@@ -29,7 +29,10 @@ var deviceObjectFixture = {
 	deviceName: 'Teensy USB Serial (COM3)',
 	manufacturer: 'PJRC.COM, LLC.',
 	serialNumber: '',
-	deviceAddress: 11
+	deviceAddress: 11,
+	mountPath: '',
+	busNumber: 1,
+	portPath: '1-1.4'
 };
 
 
@@ -41,6 +44,15 @@ describe('usb-detection', function() {
 			.that.is.an('object');
 	};
 
+	describe('`.ready`', function() {
+
+		it('should resolve once the initial device list is built', function() {
+			return usbDetect.ready.then(function() {
+				expect(usbDetect.findSync().length).to.be.greaterThan(0);
+			});
+		});
+	});
+
 	describe('`.find`', function() {
 
 		var testArrayOfDevicesShape = function(devices) {
@@ -67,6 +79,49 @@ describe('usb-detection', function() {
 		});
 	});
 
+	describe('`.findSync`', function() {
+
+		it('should return the same devices as `.find`', function() {
+			return usbDetect.find()
+				.then(function(devices) {
+					var syncDevices = usbDetect.findSync();
+					expect(syncDevices.length).to.equal(devices.length);
+					syncDevices.forEach(function(device) {
+						testDeviceShape(device);
+					});
+				});
+		});
+
+		it('should filter by vendor id', function() {
+			var vendorId = usbDetect.findSync()[0].vendorId;
+			usbDetect.findSync(vendorId).forEach(function(device) {
+				expect(device.vendorId).to.equal(vendorId);
+			});
+		});
+	});
+
+	describe('`.changesSince`', function() {
+
+		it('should have nothing new at the current generation', function() {
+			var generation = usbDetect.changesSince(0).generation;
+			var result = usbDetect.changesSince(generation);
+			expect(result.generation).to.equal(generation);
+			expect(result.resync).to.equal(false);
+			expect(result.changes).to.deep.equal([]);
+		});
+
+		it('should account for every device since generation 0', function() {
+			var result = usbDetect.changesSince(0);
+			var count = result.resync ? result.devices.length : 0;
+			result.changes.forEach(function(change) {
+				expect(['add', 'remove']).to.include(change.type);
+				testDeviceShape(change.device);
+				count += change.type === 'add' ? 1 : -1;
+			});
+			expect(count).to.equal(usbDetect.findSync().length);
+		});
+	});
+
 
 	describe('Events `.on`', function() {
 
@@ -96,6 +151,111 @@ describe('usb-detection', function() {
 					done();
 				});
 		});
+
+		it('should listen to batches of changes', function(done) {
+			console.log(chalk.black.bgCyan('Add/Insert or Remove a USB device'));
+			once('batch')
+				.then(function(changes) {
+					expect(changes.length).to.be.greaterThan(0);
+					changes.forEach(function(change) {
+						expect(['add', 'remove']).to.include(change.type);
+						testDeviceShape(change.device);
+					});
+					done();
+				});
+		});
+	});
+
+	describe('Events `.once`', function() {
+
+		it('should start monitoring again after being stopped', function(done) {
+			usbDetect.stopMonitoring();
+			console.log(chalk.black.bgCyan('Add/Insert a USB device'));
+			usbDetect.once('add', function(device) {
+				testDeviceShape(device);
+				done();
+			});
+		});
+
+		it('should route by vendor and product id', function(done) {
+			console.log(chalk.black.bgCyan('Remove a USB device and insert it again'));
+			usbDetect.once('remove', function(removed) {
+				usbDetect.once('add:' + removed.vendorId + ':' + removed.productId, function(device) {
+					testDeviceShape(device);
+					expect(device.vendorId).to.equal(removed.vendorId);
+					expect(device.productId).to.equal(removed.productId);
+					done();
+				});
+			});
+		});
+	});
+
+	describe('Device details', function() {
+
+		it('should be read on first access and not enumerated', function() {
+			var device = usbDetect.findSync()[0];
+			expect(Object.keys(device)).to.not.include('speed');
+			if(device.portPath) {
+				expect(device.speed).to.be.a('number');
+				expect(device.deviceClass).to.be.a('number');
+				expect(device.interfaceClasses).to.be.an('array');
+			}
+		});
+	});
+
+	describe('`.setInterest`', function() {
+
+		it('should reject anything but an array of filters', function() {
+			expect(function() { usbDetect.setInterest('all'); }).to.throw(TypeError);
+			expect(function() { usbDetect.setInterest([{ productId: 1 }]); }).to.throw(TypeError);
+		});
+
+		it('should not affect `.find`', function() {
+			usbDetect.setInterest([]);
+			return usbDetect.find()
+				.then(function(devices) {
+					usbDetect.setInterest(null);
+					expect(devices.length).to.be.greaterThan(0);
+				});
+		});
+	});
+
+	describe('`.setDebounce`', function() {
+
+		it('should reject a negative window', function() {
+			expect(function() { usbDetect.setDebounce(-1); }).to.throw(TypeError);
+		});
+
+		it('should count suppressed events', function() {
+			usbDetect.setDebounce(100);
+			usbDetect.setDebounce(0);
+			expect(usbDetect.getSuppressedCount()).to.be.a('number');
+		});
+	});
+
+	describe('`.getStats`', function() {
+
+		it('should time `.find` and count the devices', function() {
+			return usbDetect.find()
+				.then(function(devices) {
+					var stats = usbDetect.getStats();
+					expect(stats.latency.find.count).to.be.greaterThan(0);
+					expect(stats.latency.find.p50).to.be.at.most(stats.latency.find.max);
+					expect(stats.registry.size).to.equal(devices.length);
+					expect(stats.events.delivered).to.be.at.most(stats.events.queued);
+				});
+		});
+	});
+
+	describe('`.stopMonitoring`', function() {
+
+		it('should find devices again after being stopped', function() {
+			usbDetect.stopMonitoring();
+			return usbDetect.find()
+				.then(function(devices) {
+					expect(devices.length).to.be.greaterThan(0);
+				});
+		});
 	});
 
 });